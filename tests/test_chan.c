@@ -0,0 +1,74 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include <zpu_chan.h>
+
+#define CHAN_BASE       0x10000
+#define CHAN_SIZE       64
+
+static int failed;
+
+static void check( const char* what, bool ok )
+{
+    printf( "%s: %s\n", what, ok ? "ok" : "FAIL" );
+    if ( !ok )
+        failed = 1;
+}
+
+/**
+ * @brief A guest publishing a bogus tail must not let the host overwrite
+ * queued data it has not consumed.
+ */
+int main( void )
+{
+    static uint32_t buffer[zpu_chan_buffer_size(CHAN_SIZE)/sizeof(uint32_t)];
+    static uint8_t data[CHAN_SIZE];
+    uint8_t snapshot[CHAN_SIZE];
+    zpu_chan_t chan;
+    zpu_mem_t root;
+    zpu_mem_t seg;
+
+    zpu_mem_init( NULL, &root, "null", NULL, 0, 0, 0 );
+    zpu_chan_init( &chan, &root, &seg, "chan", buffer, CHAN_BASE, CHAN_SIZE, ZPU_CHAN_TO_GUEST );
+    memset( data, 0xA5, sizeof(data) );
+    check( "write", zpu_chan_write( &chan, data, 16 ) == 16 );
+    memcpy( snapshot, (uint8_t*)buffer + ZPU_CHAN_DATA, CHAN_SIZE );
+
+    /* tail ahead of head, head - tail wraps */
+    zpu_mem_set_uint32( &root, CHAN_BASE + ZPU_CHAN_TAIL, 100 );
+    check( "tail ahead of head", zpu_chan_write( &chan, data, CHAN_SIZE ) == 0 );
+
+    /* tail more than a ring behind head */
+    zpu_mem_set_uint32( &root, CHAN_BASE + ZPU_CHAN_HEAD, 0x1000 );
+    zpu_mem_set_uint32( &root, CHAN_BASE + ZPU_CHAN_TAIL, 0 );
+    check( "tail behind the ring", zpu_chan_write( &chan, data, CHAN_SIZE ) == 0 );
+    check( "queued data intact", memcmp( snapshot, (uint8_t*)buffer + ZPU_CHAN_DATA, CHAN_SIZE ) == 0 );
+
+    /* a consistent tail frees the ring again */
+    zpu_mem_set_uint32( &root, CHAN_BASE + ZPU_CHAN_TAIL, 0x1000 - 16 );
+    check( "room after consume", zpu_chan_write( &chan, data, CHAN_SIZE ) == CHAN_SIZE - 16 );
+
+    printf( "%s\n", failed ? "FAIL" : "PASS" );
+    return failed;
+}
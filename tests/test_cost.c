@@ -0,0 +1,78 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <stdio.h>
+
+#include <zpu_aot.h>
+#include <zpu_cost.h>
+
+#define RAM_SIZE        0x1000
+#define COUNTER         0x10
+#define SEGMENT_COST    3
+#define BUDGET          10000
+
+/* loop: mem[COUNTER] += 1, see tests/loop.bin in the Makefile */
+static const uint8_t loop[] = { 0x90, 0x08, 0x81, 0x05, 0x90, 0x0c, 0x80, 0x04 };
+
+extern const zpu_aot_t loop_aot;
+
+static void run( zpu_t* zpu, zpu_mem_t* ram, uint32_t* buffer, bool aot )
+{
+    zpu_mem_init( NULL, ram, "ram", buffer, 0, RAM_SIZE, ZPU_MEM_ATTR_RD|ZPU_MEM_ATTR_WR|ZPU_MEM_ATTR_EX );
+    for( uint32_t n=0; n < sizeof(loop); n++ )
+    {
+        zpu_mem_set_uint8( ram, n, loop[n] );
+    }
+    zpu_set_mem( zpu, ram );
+    zpu_reset( zpu, RAM_SIZE - 8 );
+    if ( aot )
+        zpu_aot_attach( zpu, &loop_aot );
+    zpu_cost_set_segment( ram, zpu, SEGMENT_COST );
+    zpu_set_cycle_budget( zpu, BUDGET );
+    zpu_execute( zpu );
+}
+
+/**
+ * @brief The same program under the interpreter and translated code must be
+ * charged the same cycles, segment costs included, and stop at the same point.
+ */
+int main( void )
+{
+    static uint32_t buffer[2][RAM_SIZE/sizeof(uint32_t)];
+    zpu_t zpu[2];
+    zpu_mem_t ram[2];
+    uint32_t counter[2];
+
+    run( &zpu[0], &ram[0], buffer[0], false );
+    run( &zpu[1], &ram[1], buffer[1], true );
+    counter[0] = zpu_mem_get_uint32( &ram[0], COUNTER );
+    counter[1] = zpu_mem_get_uint32( &ram[1], COUNTER );
+
+    printf( "interpreter: %llu cycles, counter %u\n", (unsigned long long)zpu_get_cycles(&zpu[0]), counter[0] );
+    printf( "translated:  %llu cycles, counter %u\n", (unsigned long long)zpu_get_cycles(&zpu[1]), counter[1] );
+    if ( zpu_get_cycles(&zpu[0]) != zpu_get_cycles(&zpu[1]) || counter[0] != counter[1] || counter[0] == 0 )
+    {
+        printf( "FAIL\n" );
+        return 1;
+    }
+    printf( "PASS\n" );
+    return 0;
+}
@@ -22,54 +22,11 @@
 #include <zpu.h>
 #include <zpu_mem.h>
 #include <zpu_syscall.h>
-
-#define ZPU_IM               128
-#define ZPU_BREAKPOINT       0
-#define ZPU_PUSHSP           2
-#define ZPU_POPPC            4
-#define ZPU_ADD              5
-#define ZPU_AND              6
-#define ZPU_OR               7
-#define ZPU_LOAD             8
-#define ZPU_NOT              9
-#define ZPU_FLIP             10
-#define ZPU_NOP              11
-#define ZPU_STORE            12
-#define ZPU_POPSP            13
-#define ZPU_ADDSP            16
-#define ZPU_EMULATE          32
-#define ZPU_LOADH            34
-#define ZPU_STOREH           35
-#define ZPU_LESSTHAN         36
-#define ZPU_LESSTHANOREQUAL  37
-#define ZPU_ULESSTHAN        38
-#define ZPU_ULESSTHANOREQUAL 39
-#define ZPU_SWAP             40
-#define ZPU_MULT             41
-#define ZPU_LSHIFTRIGHT      42
-#define ZPU_ASHIFTLEFT       43
-#define ZPU_ASHIFTRIGHT      44
-#define ZPU_CALL             45
-#define ZPU_EQ               46
-#define ZPU_NEQ              47
-#define ZPU_NEG              48
-#define ZPU_SUB              49
-#define ZPU_XOR              50
-#define ZPU_LOADB            51
-#define ZPU_STOREB           52
-#define ZPU_DIV              53
-#define ZPU_MOD              54
-#define ZPU_EQBRANCH         55
-#define ZPU_NEQBRANCH        56
-#define ZPU_POPPCREL         57
-#define ZPU_CONFIG           58
-#define ZPU_PUSHPC           59
-#define ZPU_SYSCALL          60
-#define ZPU_PUSHSPADD        61
-#define ZPU_MULT16X16        62
-#define ZPU_CALLPCREL        63
-#define ZPU_STORESP          64
-#define ZPU_LOADSP           96
+#include <zpu_prof.h>
+#include <zpu_hle.h>
+#include <zpu_aot.h>
+#include <zpu_opcodes.h>
+#include <zpu_cost.h>
 
 #define VECTORSIZE           0x20
 #define VECTOR_RESET         0
@@ -80,6 +37,8 @@ static void     push(zpu_t* zpu,uint32_t data);
 static uint32_t pop(zpu_t* zpu);
 static void     printRegs(zpu_t* zpu);
 static uint32_t flip(uint32_t i);
+static bool     charge(zpu_t* zpu,uint32_t cycles);
+static zpu_mem_t* aot_segment(zpu_t* zpu);
 
 void zpu_reset(zpu_t* zpu,uint32_t sp)
 {
@@ -89,15 +48,58 @@ void zpu_reset(zpu_t* zpu,uint32_t sp)
     zpu->opcode      = 0;
     zpu->pc_dirty    = true;
     zpu->decode_mask = 0;
+    zpu->prof        = NULL;
+    zpu->hle         = NULL;
+    zpu->aot         = NULL;
+    zpu->cost        = &zpu_cost_default;
+    zpu->cycles      = 0;
+    zpu->cycle_budget = UINT64_MAX;
+    zpu->timer[0]    = 0;
+    zpu->timer[1]    = 0;
 }
 
+/**
+ * @brief Run until the cycle budget is exhausted, if ever.
+ */
 void zpu_execute(zpu_t* zpu)
 {
+    uint32_t cycles = 0;
     for (;;)
     {
         zpu->pc_dirty = false;
 
+        if ( zpu->prof && --zpu->prof_countdown == 0 )
+            zpu_prof_sample( zpu->prof, zpu );
+
+        if ( zpu->aot && !zpu->decode_mask && !zpu_get_mem(zpu)->watch_ex )
+        {
+            zpu_aot_block_t block = zpu_aot_lookup( zpu->aot, zpu_get_pc(zpu) );
+            zpu_mem_t* zpu_seg;
+            if ( block && (zpu_seg = aot_segment( zpu )) != NULL )
+            {
+                uint32_t insns = block( zpu );
+                /* the fetches the interpreter would have charged */
+                if ( zpu_seg->meter )
+                    *zpu_seg->meter += (uint64_t)insns * zpu_seg->cost;
+                if ( zpu->prof && insns > 1 )
+                {
+                    /* the first instruction was counted above */
+                    for( insns -= 1; insns >= zpu->prof_countdown; )
+                    {
+                        insns -= zpu->prof_countdown;
+                        zpu_prof_sample( zpu->prof, zpu );
+                    }
+                    zpu->prof_countdown -= insns;
+                }
+                if ( charge( zpu, cycles ) )
+                    return;
+                cycles = 0;
+                continue;
+            }
+        }
+
         zpu->opcode = zpu_mem_get_opcode( zpu_get_mem(zpu), zpu_get_pc(zpu) );
+        cycles += zpu->cost->opcode[zpu->opcode];
 
         if ((zpu->opcode & 0x80) == ZPU_IM)
         {
@@ -302,12 +304,16 @@ void zpu_execute(zpu_t* zpu)
                         zpu_set_tos( zpu, zpu_get_pc(zpu) + 1 );
                         zpu_set_pc( zpu, zpu_get_nos(zpu) );
                         zpu->pc_dirty = true;
+                        if ( zpu->hle )
+                            zpu_hle_call( zpu->hle, zpu );
                         break;
                     case ZPU_CALLPCREL:
                         zpu_set_nos( zpu, zpu_get_tos(zpu) );
                         zpu_set_tos( zpu, zpu_get_pc(zpu) + 1 );
                         zpu_set_pc( zpu, zpu_get_pc(zpu) + zpu_get_nos(zpu) );
                         zpu->pc_dirty = true;
+                        if ( zpu->hle )
+                            zpu_hle_call( zpu->hle, zpu );
                         break;
                     case ZPU_EQ:
                         zpu_set_nos( zpu, pop(zpu) );
@@ -346,7 +352,42 @@ void zpu_execute(zpu_t* zpu)
             zpu_set_pc(zpu,zpu_get_pc(zpu) + 1);
             zpu->pc_dirty = true;
         }
+        else
+        {
+            if ( charge( zpu, cycles ) )
+                return;
+            cycles = 0;
+        }
+    }
+}
+
+/**
+ * @brief Commit the cycles of a basic block, update the guest timer view.
+ * @return true when the cycle budget is exhausted.
+ */
+static bool charge(zpu_t* zpu,uint32_t cycles)
+{
+    zpu->cycles += cycles;
+    zpu->timer[0] = (uint32_t)(zpu->cycles >> 32);
+    zpu->timer[1] = (uint32_t)zpu->cycles;
+    return zpu->cycles >= zpu->cycle_budget;
+}
+
+/**
+ * @brief Fetch checks for entering a translated block, as zpu_mem_get_opcode()
+ * for the block entry. A pc outside an executable segment is left to the
+ * interpreter, which raises the segmentation fault.
+ * @return the code segment or NULL.
+ */
+static zpu_mem_t* aot_segment(zpu_t* zpu)
+{
+    zpu_mem_t* zpu_seg = zpu_mem_lookup( zpu_get_mem(zpu), zpu_get_pc(zpu) );
+    if ( zpu_seg && ( ((zpu_mem_get_attr(zpu_seg) & (ZPU_MEM_ATTR_RD|ZPU_MEM_ATTR_EX)) == (ZPU_MEM_ATTR_RD|ZPU_MEM_ATTR_EX)) || !zpu_seg->prot_enabled ) )
+    {
+        zpu_opcode_fetch_notify( zpu_seg, zpu_get_pc(zpu) );
+        return zpu_seg;
     }
+    return NULL;
 }
 
 static uint32_t pop(zpu_t* zpu)
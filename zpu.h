@@ -45,6 +45,14 @@ typedef struct _zpu_
     uint32_t    cpu;
     bool        pc_dirty;
     bool        decode_mask;
+    struct _zpu_prof_*  prof;
+    uint32_t    prof_countdown;
+    struct _zpu_hle_*   hle;
+    const struct _zpu_aot_* aot;
+    const struct _zpu_cost_* cost;
+    uint64_t    cycles;
+    uint64_t    cycle_budget;
+    uint32_t    timer[2];
 } zpu_t;
 
 #define zpu_set_sp(zpu,v)       ((zpu)->sp = (v))
@@ -67,6 +75,10 @@ typedef struct _zpu_
 #define zpu_set_mem(zpu,m)      ((zpu)->mem = (m))
 #define zpu_get_mem(zpu)        ((zpu)->mem)
 
+#define zpu_get_cycles(zpu)             ((zpu)->cycles)
+#define zpu_set_cycle_budget(zpu,v)     ((zpu)->cycle_budget = (v))
+#define zpu_get_cycle_budget(zpu)       ((zpu)->cycle_budget)
+
 #define zpu_set_reset_sp(zpu,v) ((zpu)->reset_sp = (v))
 #define zpu_get_reset_sp(zpu)   ((zpu)->reset_sp)
 
@@ -0,0 +1,446 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+/**
+ * zpu2c - ahead-of-time translation of a ZPU image to host C.
+ *
+ * usage: zpu2c [-b base] [-n name] image.bin > image_aot.c
+ *
+ * Emits one function per basic block with a case label for every
+ * instruction which may be entered, and a zpu_aot_t dispatch table
+ * keyed by pc. Continuation IM instructions and the opcodes handled
+ * by consumer callbacks (BREAKPOINT, CONFIG, SYSCALL, illegal) are
+ * left to the interpreter. pc is kept current so handlers called from
+ * a block see the faulting instruction. The image must not modify its
+ * own code.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zpu_opcodes.h>
+
+static uint8_t* image;
+static uint32_t image_size;
+static uint32_t base;
+static bool*    entry;
+
+static bool     load_image( const char* path );
+static bool     is_handled( uint8_t opcode );
+static bool     is_terminator( uint8_t opcode );
+static void     emit_exit( FILE* fp, const char* pc, bool decode_mask );
+static void     emit_return( FILE* fp );
+static void     emit_opcode( FILE* fp, uint32_t pc, uint8_t opcode, bool decode_mask );
+static void     emit_binop( FILE* fp, const char* expr );
+
+int main( int argc, char* argv[] )
+{
+    const char* name = "zpu_aot";
+    FILE* fp = stdout;
+    bool in_block = false;
+    bool decode_mask = false;
+    bool first_case = false;
+    int opt;
+
+    while ( (opt = getopt( argc, argv, "b:n:" )) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'b':
+                base = (uint32_t)strtoul( optarg, NULL, 0 );
+                break;
+            case 'n':
+                name = optarg;
+                break;
+            default:
+                fprintf( stderr, "usage: %s [-b base] [-n name] image.bin\n", argv[0] );
+                return 1;
+        }
+    }
+    if ( optind >= argc || !load_image( argv[optind] ) )
+    {
+        fprintf( stderr, "usage: %s [-b base] [-n name] image.bin\n", argv[0] );
+        return 1;
+    }
+    if ( (entry = (bool*)calloc( image_size ? image_size : 1, sizeof(bool) )) == NULL )
+        return 1;
+
+    fprintf( fp, "/* generated by zpu2c from %s, do not edit */\n", argv[optind] );
+    fprintf( fp, "#include <zpu_aot.h>\n\n" );
+
+    for( uint32_t offset=0; offset < image_size; offset++ )
+    {
+        uint32_t pc = base + offset;
+        uint8_t opcode = image[offset];
+        char pc_text[16];
+
+        snprintf( pc_text, sizeof(pc_text), "0x%08xu", pc );
+        if ( !is_handled( opcode ) )
+        {
+            if ( in_block )
+            {
+                emit_exit( fp, pc_text, decode_mask );
+                fprintf( fp, "    }\n    return insns;\n}\n\n" );
+                in_block = false;
+            }
+            decode_mask = false;
+            continue;
+        }
+        if ( !in_block )
+        {
+            fprintf( fp, "static uint32_t zpu_aot_block_%08x( zpu_t* zpu )\n{\n", pc );
+            fprintf( fp, "    uint32_t insns = 0;\n" );
+            fprintf( fp, "    uint32_t cycles = 0;\n" );
+            fprintf( fp, "    switch ( zpu_get_pc(zpu) )\n    {\n" );
+            in_block = true;
+            first_case = true;
+        }
+        if ( !( (opcode & 0x80) == ZPU_IM && decode_mask ) )
+        {
+            if ( !first_case )
+                fprintf( fp, "            /* fall through */\n" );
+            fprintf( fp, "        case 0x%08xu:\n", pc );
+            first_case = false;
+            entry[offset] = true;
+        }
+        fprintf( fp, "            zpu_set_pc( zpu, 0x%08xu );\n", pc );
+        fprintf( fp, "            ++insns;\n" );
+        fprintf( fp, "            cycles += zpu->cost->opcode[0x%02x];\n", opcode );
+        emit_opcode( fp, pc, opcode, decode_mask );
+        decode_mask = ( (opcode & 0x80) == ZPU_IM );
+        if ( is_terminator( opcode ) )
+        {
+            fprintf( fp, "    }\n    return insns;\n}\n\n" );
+            in_block = false;
+        }
+    }
+    if ( in_block )
+    {
+        char pc_text[16];
+        snprintf( pc_text, sizeof(pc_text), "0x%08xu", base + image_size );
+        emit_exit( fp, pc_text, decode_mask );
+        fprintf( fp, "    }\n    return insns;\n}\n\n" );
+    }
+
+    fprintf( fp, "static const zpu_aot_block_t %s_blocks[] =\n{\n", name );
+    for( uint32_t offset=0, block=base; offset < image_size; offset++ )
+    {
+        uint8_t opcode = image[offset];
+        if ( !is_handled( opcode ) )
+        {
+            fprintf( fp, "    NULL,\n" );
+            if ( offset + 1 < image_size )
+                block = base + offset + 1;
+            continue;
+        }
+        if ( entry[offset] )
+            fprintf( fp, "    zpu_aot_block_%08x,\n", block );
+        else
+            fprintf( fp, "    NULL,\n" );
+        if ( is_terminator( opcode ) )
+            block = base + offset + 1;
+    }
+    fprintf( fp, "    NULL\n};\n\n" );
+    fprintf( fp, "const zpu_aot_t %s = { 0x%08xu, 0x%08xu, %s_blocks };\n", name, base, image_size, name );
+
+    free( entry );
+    free( image );
+    return 0;
+}
+
+static bool load_image( const char* path )
+{
+    FILE* fp = fopen( path, "rb" );
+    long size;
+    if ( fp == NULL )
+        return false;
+    if ( fseek( fp, 0, SEEK_END ) != 0 || (size = ftell( fp )) < 0 || fseek( fp, 0, SEEK_SET ) != 0 )
+    {
+        fclose( fp );
+        return false;
+    }
+    image_size = (uint32_t)size;
+    image = (uint8_t*)malloc( size ? size : 1 );
+    if ( image == NULL || fread( image, 1, size, fp ) != (size_t)size )
+    {
+        fclose( fp );
+        return false;
+    }
+    fclose( fp );
+    return true;
+}
+
+/** opcodes translated here, the remainder call consumer handlers in the interpreter */
+static bool is_handled( uint8_t opcode )
+{
+    if ( (opcode & 0x80) == ZPU_IM || (opcode & 0xF0) == ZPU_ADDSP || 
+         (opcode & 0xE0) == ZPU_LOADSP || (opcode & 0xE0) == ZPU_STORESP )
+        return true;
+    switch ( opcode )
+    {
+        case ZPU_BREAKPOINT:
+        case ZPU_CONFIG:
+        case ZPU_SYSCALL:
+            return false;
+        case ZPU_PUSHPC:        case ZPU_OR:            case ZPU_NOT:
+        case ZPU_LOAD:          case ZPU_PUSHSPADD:     case ZPU_STORE:
+        case ZPU_POPPC:         case ZPU_POPPCREL:      case ZPU_FLIP:
+        case ZPU_ADD:           case ZPU_SUB:           case ZPU_PUSHSP:
+        case ZPU_POPSP:         case ZPU_NOP:           case ZPU_AND:
+        case ZPU_XOR:           case ZPU_LOADB:         case ZPU_STOREB:
+        case ZPU_LOADH:         case ZPU_STOREH:        case ZPU_LESSTHAN:
+        case ZPU_LESSTHANOREQUAL:                       case ZPU_ULESSTHAN:
+        case ZPU_ULESSTHANOREQUAL:                      case ZPU_SWAP:
+        case ZPU_MULT16X16:     case ZPU_EQBRANCH:      case ZPU_NEQBRANCH:
+        case ZPU_MULT:          case ZPU_DIV:           case ZPU_MOD:
+        case ZPU_LSHIFTRIGHT:   case ZPU_ASHIFTLEFT:    case ZPU_ASHIFTRIGHT:
+        case ZPU_CALL:          case ZPU_CALLPCREL:     case ZPU_EQ:
+        case ZPU_NEQ:           case ZPU_NEG:
+            return true;
+    }
+    return false;
+}
+
+static bool is_terminator( uint8_t opcode )
+{
+    switch ( opcode )
+    {
+        case ZPU_POPPC:
+        case ZPU_POPPCREL:
+        case ZPU_EQBRANCH:
+        case ZPU_NEQBRANCH:
+        case ZPU_CALL:
+        case ZPU_CALLPCREL:
+            return true;
+    }
+    return false;
+}
+
+static void emit_exit( FILE* fp, const char* pc, bool decode_mask )
+{
+    fprintf( fp, "            zpu_set_pc( zpu, %s );\n", pc );
+    fprintf( fp, "            zpu->decode_mask = %s;\n", decode_mask ? "true" : "false" );
+    emit_return( fp );
+}
+
+/** blocks commit their cycles once and return the number of instructions executed */
+static void emit_return( FILE* fp )
+{
+    fprintf( fp, "            zpu->cycles += cycles;\n" );
+    fprintf( fp, "            return insns;\n" );
+}
+
+static void emit_binop( FILE* fp, const char* expr )
+{
+    fprintf( fp, "            zpu_set_nos( zpu, zpu_aot_pop(zpu) );\n" );
+    fprintf( fp, "            zpu_set_tos( zpu, %s );\n", expr );
+}
+
+/** mirrors the decoding and semantics of zpu_execute() */
+static void emit_opcode( FILE* fp, uint32_t pc, uint8_t opcode, bool decode_mask )
+{
+    char text[64];
+    if ( (opcode & 0x80) == ZPU_IM )
+    {
+        if ( decode_mask )
+        {
+            fprintf( fp, "            zpu_set_tos( zpu, (zpu_get_tos(zpu) << 7) | 0x%02x );\n", opcode & 0x7f );
+        }
+        else
+        {
+            fprintf( fp, "            zpu_aot_push( zpu, zpu_get_tos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, 0x%08xu );\n", (uint32_t)(((int32_t)((uint32_t)opcode << 25)) >> 25) );
+        }
+        return;
+    }
+    if ( (opcode & 0xF0) == ZPU_ADDSP )
+    {
+        if ( (opcode & 0x0F) == 0 )
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_get_tos(zpu) + zpu_get_tos(zpu) );\n" );
+        else
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_get_tos(zpu) + zpu_mem_get_uint32( zpu_get_mem(zpu), zpu_get_sp(zpu) + %u ) );\n", (opcode & 0x0F) * 4 );
+        return;
+    }
+    if ( (opcode & 0xE0) == ZPU_LOADSP )
+    {
+        fprintf( fp, "            {\n" );
+        fprintf( fp, "                uint32_t addr = zpu_get_sp(zpu) + %u;\n", ((opcode & 0x1F) ^ 0x10) * 4 );
+        fprintf( fp, "                zpu_aot_push( zpu, zpu_get_tos(zpu) );\n" );
+        fprintf( fp, "                zpu_set_tos( zpu, zpu_mem_get_uint32( zpu_get_mem(zpu), addr ) );\n" );
+        fprintf( fp, "            }\n" );
+        return;
+    }
+    if ( (opcode & 0xE0) == ZPU_STORESP )
+    {
+        fprintf( fp, "            zpu_mem_set_uint32( zpu_get_mem(zpu), zpu_get_sp(zpu) + %u, zpu_get_tos(zpu) );\n", ((opcode & 0x1F) ^ 0x10) * 4 );
+        fprintf( fp, "            zpu_set_tos( zpu, zpu_aot_pop(zpu) );\n" );
+        return;
+    }
+    switch ( opcode )
+    {
+        case ZPU_PUSHPC:
+            fprintf( fp, "            zpu_aot_push( zpu, zpu_get_tos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, 0x%08xu );\n", pc );
+            break;
+        case ZPU_OR:
+            emit_binop( fp, "zpu_get_tos(zpu) | zpu_get_nos(zpu)" );
+            break;
+        case ZPU_NOT:
+            fprintf( fp, "            zpu_set_tos( zpu, ~zpu_get_tos(zpu) );\n" );
+            break;
+        case ZPU_LOAD:
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_mem_get_uint32( zpu_get_mem(zpu), zpu_get_tos(zpu) ) );\n" );
+            break;
+        case ZPU_PUSHSPADD:
+            fprintf( fp, "            zpu_set_tos( zpu, (zpu_get_tos(zpu) * 4) + zpu_get_sp(zpu) );\n" );
+            break;
+        case ZPU_STORE:
+            fprintf( fp, "            zpu_set_nos( zpu, zpu_aot_pop(zpu) );\n" );
+            fprintf( fp, "            zpu_mem_set_uint32( zpu_get_mem(zpu), zpu_get_tos(zpu), zpu_get_nos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_aot_pop(zpu) );\n" );
+            break;
+        case ZPU_POPPC:
+            fprintf( fp, "            zpu_set_pc( zpu, zpu_get_tos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_aot_pop(zpu) );\n" );
+            fprintf( fp, "            zpu->decode_mask = false;\n" );
+            emit_return( fp );
+            break;
+        case ZPU_POPPCREL:
+            fprintf( fp, "            zpu_set_pc( zpu, 0x%08xu + zpu_get_tos(zpu) );\n", pc );
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_aot_pop(zpu) );\n" );
+            fprintf( fp, "            zpu->decode_mask = false;\n" );
+            emit_return( fp );
+            break;
+        case ZPU_FLIP:
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_aot_flip( zpu_get_tos(zpu) ) );\n" );
+            break;
+        case ZPU_ADD:
+            emit_binop( fp, "zpu_get_tos(zpu) + zpu_get_nos(zpu)" );
+            break;
+        case ZPU_SUB:
+            emit_binop( fp, "zpu_get_nos(zpu) - zpu_get_tos(zpu)" );
+            break;
+        case ZPU_PUSHSP:
+            fprintf( fp, "            zpu_aot_push( zpu, zpu_get_tos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_get_sp(zpu) + 4 );\n" );
+            break;
+        case ZPU_POPSP:
+            fprintf( fp, "            zpu_set_sp( zpu, zpu_get_tos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_mem_get_uint32( zpu_get_mem(zpu), zpu_get_sp(zpu) ) );\n" );
+            break;
+        case ZPU_NOP:
+            break;
+        case ZPU_AND:
+            emit_binop( fp, "zpu_get_tos(zpu) & zpu_get_nos(zpu)" );
+            break;
+        case ZPU_XOR:
+            emit_binop( fp, "zpu_get_tos(zpu) ^ zpu_get_nos(zpu)" );
+            break;
+        case ZPU_LOADB:
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_mem_get_uint8( zpu_get_mem(zpu), zpu_get_tos(zpu) ) );\n" );
+            break;
+        case ZPU_STOREB:
+            fprintf( fp, "            zpu_set_nos( zpu, zpu_aot_pop(zpu) );\n" );
+            fprintf( fp, "            zpu_mem_set_uint8( zpu_get_mem(zpu), zpu_get_tos(zpu), zpu_get_nos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_aot_pop(zpu) );\n" );
+            break;
+        case ZPU_LOADH:
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_mem_get_uint16( zpu_get_mem(zpu), zpu_get_tos(zpu) ) );\n" );
+            break;
+        case ZPU_STOREH:
+            fprintf( fp, "            zpu_set_nos( zpu, zpu_aot_pop(zpu) );\n" );
+            fprintf( fp, "            zpu_mem_set_uint16( zpu_get_mem(zpu), zpu_get_tos(zpu), zpu_get_nos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_aot_pop(zpu) );\n" );
+            break;
+        case ZPU_LESSTHAN:
+            emit_binop( fp, "((int32_t)zpu_get_tos(zpu) < (int32_t)zpu_get_nos(zpu)) ? 1 : 0" );
+            break;
+        case ZPU_LESSTHANOREQUAL:
+            emit_binop( fp, "((int32_t)zpu_get_tos(zpu) <= (int32_t)zpu_get_nos(zpu)) ? 1 : 0" );
+            break;
+        case ZPU_ULESSTHAN:
+            emit_binop( fp, "(zpu_get_tos(zpu) < zpu_get_nos(zpu)) ? 1 : 0" );
+            break;
+        case ZPU_ULESSTHANOREQUAL:
+            emit_binop( fp, "(zpu_get_tos(zpu) <= zpu_get_nos(zpu)) ? 1 : 0" );
+            break;
+        case ZPU_SWAP:
+            fprintf( fp, "            zpu_set_tos( zpu, ((zpu_get_tos(zpu) >> 16) & 0xffff) | (zpu_get_tos(zpu) << 16) );\n" );
+            break;
+        case ZPU_MULT16X16:
+            emit_binop( fp, "((int32_t)zpu_get_nos(zpu) & 0xffff) * (zpu_get_tos(zpu) & 0xffff)" );
+            break;
+        case ZPU_EQBRANCH:
+        case ZPU_NEQBRANCH:
+            fprintf( fp, "            zpu_set_nos( zpu, zpu_aot_pop(zpu) );\n" );
+            fprintf( fp, "            zpu_set_pc( zpu, (zpu_get_nos(zpu) %s 0) ? 0x%08xu + zpu_get_tos(zpu) : 0x%08xu );\n", 
+                            opcode == ZPU_EQBRANCH ? "==" : "!=", pc, pc + 1 );
+            fprintf( fp, "            zpu_set_tos( zpu, zpu_aot_pop(zpu) );\n" );
+            fprintf( fp, "            zpu->decode_mask = false;\n" );
+            emit_return( fp );
+            break;
+        case ZPU_MULT:
+            emit_binop( fp, "(int32_t)zpu_get_tos(zpu) * (int32_t)zpu_get_nos(zpu)" );
+            break;
+        case ZPU_DIV:
+        case ZPU_MOD:
+            fprintf( fp, "            zpu_set_nos( zpu, zpu_aot_pop(zpu) );\n" );
+            fprintf( fp, "            if ( zpu_get_nos(zpu) == 0 )\n" );
+            fprintf( fp, "                zpu_divzero_handler( zpu );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, (int32_t)zpu_get_tos(zpu) %c (int32_t)zpu_get_nos(zpu) );\n", opcode == ZPU_DIV ? '/' : '%' );
+            break;
+        case ZPU_LSHIFTRIGHT:
+            emit_binop( fp, "zpu_get_nos(zpu) >> (zpu_get_tos(zpu) & 0x3f)" );
+            break;
+        case ZPU_ASHIFTLEFT:
+            emit_binop( fp, "zpu_get_nos(zpu) << (zpu_get_tos(zpu) & 0x3f)" );
+            break;
+        case ZPU_ASHIFTRIGHT:
+            emit_binop( fp, "zpu_get_nos(zpu) >> (zpu_get_tos(zpu) & 0x3f)" );
+            break;
+        case ZPU_CALL:
+        case ZPU_CALLPCREL:
+            if ( opcode == ZPU_CALL )
+                snprintf( text, sizeof(text), "zpu_get_nos(zpu)" );
+            else
+                snprintf( text, sizeof(text), "0x%08xu + zpu_get_nos(zpu)", pc );
+            fprintf( fp, "            zpu_set_nos( zpu, zpu_get_tos(zpu) );\n" );
+            fprintf( fp, "            zpu_set_tos( zpu, 0x%08xu );\n", pc + 1 );
+            fprintf( fp, "            zpu_set_pc( zpu, %s );\n", text );
+            fprintf( fp, "            zpu->decode_mask = false;\n" );
+            fprintf( fp, "            if ( zpu->hle )\n" );
+            fprintf( fp, "                zpu_hle_call( zpu->hle, zpu );\n" );
+            emit_return( fp );
+            break;
+        case ZPU_EQ:
+            emit_binop( fp, "(zpu_get_nos(zpu) == zpu_get_tos(zpu)) ? 1 : 0" );
+            break;
+        case ZPU_NEQ:
+            emit_binop( fp, "(zpu_get_nos(zpu) != zpu_get_tos(zpu)) ? 1 : 0" );
+            break;
+        case ZPU_NEG:
+            fprintf( fp, "            zpu_set_tos( zpu, -zpu_get_tos(zpu) );\n" );
+            break;
+    }
+}
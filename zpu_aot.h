@@ -0,0 +1,76 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_AOT_H
+#define ZPU_AOT_H
+
+#include <zpu.h>
+#include <zpu_mem.h>
+#include <zpu_hle.h>
+#include <zpu_cost.h>
+
+/**
+ * Execution engine produced by the zpu2c ahead-of-time translator.
+ * 'blocks' holds one entry per byte of the image, the translated block
+ * entered at that pc, or NULL where zpu_execute() must interpret.
+ * Blocks are only entered when decode_mask is clear and pc lies in an
+ * executable segment, and return the number of instructions executed.
+ * zpu_opcode_fetch_notify() is called once per block entry rather than per
+ * instruction.
+ */
+typedef uint32_t (*zpu_aot_block_t)( zpu_t* zpu );
+
+typedef struct _zpu_aot_
+{
+    uint32_t                base;
+    uint32_t                size;
+    const zpu_aot_block_t*  blocks;
+} zpu_aot_t;
+
+#define zpu_aot_attach(zpu,a)       ((zpu)->aot = (a))
+#define zpu_aot_detach(zpu)         ((zpu)->aot = NULL)
+
+#define zpu_aot_lookup(aot,pc)      ( ((pc) - (aot)->base) < (aot)->size ? (aot)->blocks[(pc) - (aot)->base] : NULL )
+
+/** stack helpers for translated code, as push() and pop() in zpu.c */
+static inline void zpu_aot_push( zpu_t* zpu, uint32_t data )
+{
+    zpu_mem_set_uint32( zpu_get_mem(zpu), zpu_get_sp(zpu), data );
+    zpu_dec_sp(zpu);
+}
+
+static inline uint32_t zpu_aot_pop( zpu_t* zpu )
+{
+    zpu_inc_sp(zpu);
+    return zpu_mem_get_uint32( zpu_get_mem(zpu), zpu_get_sp(zpu) );
+}
+
+static inline uint32_t zpu_aot_flip( uint32_t i )
+{
+    uint32_t t = 0;
+    for (int j = 0; j < 32; j++)
+    {
+        t |= ((i >> j) & 1) << (31 - j);
+    }
+    return t;
+}
+
+#endif
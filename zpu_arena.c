@@ -0,0 +1,159 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+    #include <sys/syscall.h>
+#endif
+
+#include <zpu_arena.h>
+
+#if !defined(MAP_HUGETLB)
+    #define MAP_HUGETLB     0
+#endif
+#if !defined(MAP_NORESERVE)
+    #define MAP_NORESERVE   0
+#endif
+#define ARENA_MPOL_BIND     2
+
+static size_t   arena_round_up( size_t n, size_t align );
+static void     arena_bind_node( void* base, size_t size, int numa_node );
+
+/**
+ * @brief Reserve an arena of at least size bytes.
+ * Explicit huge pages are used when the system has them reserved, otherwise
+ * the arena is aligned to a huge page and transparent huge pages are requested.
+ * @param numa_node bind the arena to a NUMA node, or ZPU_ARENA_NODE_ANY.
+ */
+extern bool zpu_arena_init( zpu_arena_t* arena, size_t size, int numa_node )
+{
+    void* base;
+
+    size = arena_round_up( size, ZPU_ARENA_HUGE_PAGE );
+    arena->used = 0;
+    arena->size = size;
+    arena->hugetlb = false;
+
+    base = MAP_HUGETLB ? mmap( NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0 ) : MAP_FAILED;
+    if ( base != MAP_FAILED )
+    {
+        arena->hugetlb = true;
+    }
+    else
+    {
+        uint8_t* p;
+        size_t head;
+        base = mmap( NULL, size + ZPU_ARENA_HUGE_PAGE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0 );
+        if ( base == MAP_FAILED )
+        {
+            arena->base = NULL;
+            return false;
+        }
+        p = (uint8_t*)base;
+        head = arena_round_up( (uintptr_t)p, ZPU_ARENA_HUGE_PAGE ) - (uintptr_t)p;
+        if ( head )
+            munmap( p, head );
+        if ( ZPU_ARENA_HUGE_PAGE - head )
+            munmap( p + head + size, ZPU_ARENA_HUGE_PAGE - head );
+        base = p + head;
+        #if defined(MADV_HUGEPAGE)
+            madvise( base, size, MADV_HUGEPAGE );
+        #endif
+    }
+    arena->base = (uint8_t*)base;
+    arena_bind_node( base, size, numa_node );
+    return true;
+}
+
+/**
+ * @brief Allocate zero filled memory from the arena.
+ * @return the allocation or NULL when the arena is exhausted.
+ */
+extern void* zpu_arena_alloc( zpu_arena_t* arena, size_t size, size_t align )
+{
+    size_t offset = arena_round_up( arena->used, align ? align : ZPU_ARENA_CACHE_LINE );
+    if ( arena->base && offset <= arena->size && size <= arena->size - offset )
+    {
+        arena->used = offset + size;
+        return arena->base + offset;
+    }
+    return NULL;
+}
+
+extern void zpu_arena_release( zpu_arena_t* arena )
+{
+    if ( arena->base )
+    {
+        munmap( arena->base, arena->size );
+        arena->base = NULL;
+    }
+    arena->size = 0;
+    arena->used = 0;
+}
+
+extern zpu_t* zpu_arena_alloc_zpu( zpu_arena_t* arena )
+{
+    return (zpu_t*)zpu_arena_alloc( arena, sizeof(zpu_t), ZPU_ARENA_CACHE_LINE );
+}
+
+/**
+ * @brief Allocate a segment descriptor and its physical buffer from the arena
+ * and append it to zpu_mem_root. Buffers of a huge page or more are huge page
+ * aligned, smaller ones page aligned.
+ * @return the segment, or NULL when the arena is exhausted.
+ */
+extern zpu_mem_t* zpu_mem_alloc_segment( zpu_arena_t* arena,
+                                         zpu_mem_t* zpu_mem_root, 
+                                         const char* name, 
+                                         uint32_t virtual_base, 
+                                         uint32_t size,
+                                         uint8_t attr )
+{
+    zpu_mem_t* zpu_mem_seg;
+    void* physical_base;
+    size_t align = ( size >= ZPU_ARENA_HUGE_PAGE ) ? ZPU_ARENA_HUGE_PAGE : ZPU_ARENA_PAGE;
+
+    if ( (physical_base = zpu_arena_alloc( arena, size, align )) == NULL )
+        return NULL;
+    if ( (zpu_mem_seg = (zpu_mem_t*)zpu_arena_alloc( arena, sizeof(zpu_mem_t), ZPU_ARENA_CACHE_LINE )) == NULL )
+        return NULL;
+    zpu_mem_seg->next = NULL;
+    zpu_mem_init( zpu_mem_root, zpu_mem_seg, name, physical_base, virtual_base, size, attr );
+    return zpu_mem_seg;
+}
+
+static size_t arena_round_up( size_t n, size_t align )
+{
+    return ( n + align - 1 ) & ~( align - 1 );
+}
+
+static void arena_bind_node( void* base, size_t size, int numa_node )
+{
+    #if defined(__linux__) && defined(SYS_mbind)
+        if ( numa_node >= 0 && numa_node < 64 )
+        {
+            unsigned long nodemask = 1UL << numa_node;
+            syscall( SYS_mbind, base, size, ARENA_MPOL_BIND, &nodemask, sizeof(nodemask) * 8, 0 );
+        }
+    #endif
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_ARENA_H
+#define ZPU_ARENA_H
+
+#include <zpu.h>
+#include <zpu_mem.h>
+
+#define ZPU_ARENA_HUGE_PAGE     (2*1024*1024)
+#define ZPU_ARENA_PAGE          4096
+#define ZPU_ARENA_CACHE_LINE    64
+#define ZPU_ARENA_NODE_ANY      (-1)
+
+/**
+ * A huge page backed bump allocator holding all of one instance's
+ * segments, its zpu_t and caches. Freeing the instance is a single
+ * zpu_arena_release().
+ */
+typedef struct _zpu_arena_
+{
+    uint8_t*            base;
+    size_t              size;
+    size_t              used;
+    bool                hugetlb;
+} zpu_arena_t;
+
+#define zpu_arena_get_used(arena)               ((arena)->used)
+#define zpu_arena_get_size(arena)               ((arena)->size)
+
+extern bool     zpu_arena_init      ( zpu_arena_t* arena, size_t size, int numa_node );
+extern void*    zpu_arena_alloc     ( zpu_arena_t* arena, size_t size, size_t align );
+extern void     zpu_arena_release   ( zpu_arena_t* arena );
+extern zpu_t*   zpu_arena_alloc_zpu ( zpu_arena_t* arena );
+
+extern zpu_mem_t* zpu_mem_alloc_segment( zpu_arena_t* arena,
+                                         zpu_mem_t* zpu_mem_root, 
+                                         const char* name, 
+                                         uint32_t virtual_base, 
+                                         uint32_t size,
+                                         uint8_t attr );
+
+#endif
@@ -0,0 +1,140 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <string.h>
+
+#include <zpu_chan.h>
+
+#define CHAN_WORD(chan,offset)      ((uint32_t*)((chan)->base + (offset)))
+#define CHAN_LANE(offset)           ((offset)^0x03)
+
+/**
+ * @brief Map a host buffer of zpu_chan_buffer_size(size) bytes into the guest
+ * at virtual_base. The segment is ZPU_MEM_ATTR_SYNC so guest loads and stores
+ * of head and tail are ordered against the host.
+ * @param size data capacity in bytes, a power of two.
+ */
+extern bool zpu_chan_init( zpu_chan_t* chan,
+                           zpu_mem_t* zpu_mem_root,
+                           zpu_mem_t* zpu_mem_seg,
+                           const char* name,
+                           void* buffer,
+                           uint32_t virtual_base,
+                           uint32_t size,
+                           uint8_t direction )
+{
+    if ( size == 0 || ( size & (size - 1) ) || ( (uintptr_t)buffer & 0x03 ) )
+        return false;
+    memset( buffer, 0, zpu_chan_buffer_size(size) );
+    chan->seg = zpu_mem_seg;
+    chan->base = (uint8_t*)buffer;
+    chan->size = size;
+    chan->direction = direction;
+    chan->doorbell = NULL;
+    chan->arg = NULL;
+    *CHAN_WORD( chan, ZPU_CHAN_SIZE ) = size;
+    zpu_mem_init( zpu_mem_root, 
+                  zpu_mem_seg, 
+                  name, 
+                  buffer, 
+                  virtual_base, 
+                  zpu_chan_buffer_size(size), 
+                  ZPU_MEM_ATTR_RD|ZPU_MEM_ATTR_WR|ZPU_MEM_ATTR_SYNC );
+    return true;
+}
+
+/**
+ * @brief Host producer, copy up to len bytes into a ZPU_CHAN_TO_GUEST channel.
+ * @return the number of bytes queued.
+ */
+extern uint32_t zpu_chan_write( zpu_chan_t* chan, const void* data, uint32_t len )
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint8_t* ring = chan->base + ZPU_CHAN_DATA;
+    uint32_t head = *CHAN_WORD( chan, ZPU_CHAN_HEAD );
+    uint32_t tail = __atomic_load_n( CHAN_WORD( chan, ZPU_CHAN_TAIL ), __ATOMIC_ACQUIRE );
+    uint32_t used = head - tail;
+    uint32_t room;
+    if ( chan->direction != ZPU_CHAN_TO_GUEST )
+        return 0;
+    /* a tail published outside head-size..head is a corrupt ring, queue nothing */
+    room = used > chan->size ? 0 : chan->size - used;
+    if ( len > room )
+        len = room;
+    for( uint32_t n=0; n < len; n++ )
+    {
+        ring[ CHAN_LANE( (head + n) & (chan->size - 1) ) ] = p[n];
+    }
+    __atomic_store_n( CHAN_WORD( chan, ZPU_CHAN_HEAD ), head + len, __ATOMIC_RELEASE );
+    return len;
+}
+
+/**
+ * @brief Host consumer, copy up to len bytes out of a ZPU_CHAN_TO_HOST channel.
+ * @return the number of bytes read.
+ */
+extern uint32_t zpu_chan_read( zpu_chan_t* chan, void* data, uint32_t len )
+{
+    uint8_t* p = (uint8_t*)data;
+    const uint8_t* ring = chan->base + ZPU_CHAN_DATA;
+    uint32_t tail = *CHAN_WORD( chan, ZPU_CHAN_TAIL );
+    uint32_t head = __atomic_load_n( CHAN_WORD( chan, ZPU_CHAN_HEAD ), __ATOMIC_ACQUIRE );
+    uint32_t avail = head - tail;
+    if ( chan->direction != ZPU_CHAN_TO_HOST )
+        return 0;
+    if ( avail > chan->size )
+        avail = chan->size;
+    if ( len > avail )
+        len = avail;
+    for( uint32_t n=0; n < len; n++ )
+    {
+        p[n] = ring[ CHAN_LANE( (tail + n) & (chan->size - 1) ) ];
+    }
+    __atomic_store_n( CHAN_WORD( chan, ZPU_CHAN_TAIL ), tail + len, __ATOMIC_RELEASE );
+    return len;
+}
+
+/**
+ * @return bytes queued and not yet consumed.
+ */
+extern uint32_t zpu_chan_pending( zpu_chan_t* chan )
+{
+    uint32_t head = __atomic_load_n( CHAN_WORD( chan, ZPU_CHAN_HEAD ), __ATOMIC_ACQUIRE );
+    uint32_t tail = __atomic_load_n( CHAN_WORD( chan, ZPU_CHAN_TAIL ), __ATOMIC_ACQUIRE );
+    return head - tail;
+}
+
+/**
+ * @brief Call from zpu_mem_override_set_uint32(), rings the channel doorbell
+ * callback when the guest stores to ZPU_CHAN_DOORBELL.
+ * @return true if the store was the doorbell of this channel.
+ */
+extern bool zpu_chan_doorbell( zpu_chan_t* chan, zpu_mem_t* zpu_mem, uint32_t va, uint32_t w )
+{
+    if ( zpu_mem == chan->seg && va == zpu_mem->virtual_base + ZPU_CHAN_DOORBELL )
+    {
+        __atomic_store_n( CHAN_WORD( chan, ZPU_CHAN_DOORBELL ), w, __ATOMIC_RELEASE );
+        if ( chan->doorbell )
+            chan->doorbell( chan, w );
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,79 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_CHAN_H
+#define ZPU_CHAN_H
+
+#include <zpu.h>
+#include <zpu_mem.h>
+
+/** 
+ * Channel layout, offsets from the segment virtual base. head and tail are
+ * free running byte counts, size is the capacity of data, a power of two.
+ */
+#define ZPU_CHAN_HEAD           0x00
+#define ZPU_CHAN_TAIL           0x40
+#define ZPU_CHAN_SIZE           0x80
+#define ZPU_CHAN_DOORBELL       0x84
+#define ZPU_CHAN_DATA           0xC0
+
+#define ZPU_CHAN_TO_GUEST       0
+#define ZPU_CHAN_TO_HOST        1
+
+typedef struct _zpu_chan_ zpu_chan_t;
+
+typedef void (*zpu_chan_doorbell_t)( zpu_chan_t* chan, uint32_t w );
+
+/**
+ * A single producer, single consumer byte ring in a host buffer mapped into
+ * the guest address space. The host side is the producer of a
+ * ZPU_CHAN_TO_GUEST channel and the consumer of a ZPU_CHAN_TO_HOST channel.
+ */
+struct _zpu_chan_
+{
+    zpu_mem_t*          seg;
+    uint8_t*            base;
+    uint32_t            size;
+    uint8_t             direction;
+    zpu_chan_doorbell_t doorbell;
+    void*               arg;
+};
+
+#define zpu_chan_get_seg(chan)                  ((chan)->seg)
+#define zpu_chan_get_arg(chan)                  ((chan)->arg)
+#define zpu_chan_set_doorbell(chan,fn,a)        ((chan)->doorbell = (fn), (chan)->arg = (a))
+#define zpu_chan_buffer_size(size)              (ZPU_CHAN_DATA + (size))
+
+extern bool     zpu_chan_init   ( zpu_chan_t* chan,
+                                  zpu_mem_t* zpu_mem_root,
+                                  zpu_mem_t* zpu_mem_seg,
+                                  const char* name,
+                                  void* buffer,
+                                  uint32_t virtual_base,
+                                  uint32_t size,
+                                  uint8_t direction );
+
+extern uint32_t zpu_chan_write   ( zpu_chan_t* chan, const void* data, uint32_t len );
+extern uint32_t zpu_chan_read    ( zpu_chan_t* chan, void* data, uint32_t len );
+extern uint32_t zpu_chan_pending ( zpu_chan_t* chan );
+extern bool     zpu_chan_doorbell( zpu_chan_t* chan, zpu_mem_t* zpu_mem, uint32_t va, uint32_t w );
+
+#endif
@@ -0,0 +1,81 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <zpu_cost.h>
+#include <zpu_opcodes.h>
+
+#define COST_16         1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1
+#define COST_256        COST_16,COST_16,COST_16,COST_16,COST_16,COST_16,COST_16,COST_16, \
+                        COST_16,COST_16,COST_16,COST_16,COST_16,COST_16,COST_16,COST_16
+
+const zpu_cost_t zpu_cost_default = { { COST_256 }, ZPU_COST_HLE_CALL, ZPU_COST_HLE_WORD };
+
+/**
+ * @brief Fill a cost table with a flat per opcode cost, HLE charges are scaled
+ * to match. Adjust with zpu_cost_set_opcode() and zpu_cost_set_hle().
+ */
+extern void zpu_cost_init( zpu_cost_t* cost, uint16_t cycles )
+{
+    for( int opcode=0; opcode < 256; opcode++ )
+    {
+        cost->opcode[opcode] = cycles;
+    }
+    cost->hle_call = ZPU_COST_HLE_CALL * cycles;
+    cost->hle_word = ZPU_COST_HLE_WORD * cycles;
+}
+
+/**
+ * @brief Meter an instance with a cost table, must follow zpu_reset().
+ */
+extern void zpu_cost_attach( zpu_cost_t* cost, zpu_t* zpu )
+{
+    zpu->cost = cost;
+}
+
+/**
+ * @brief Charge every load, store and fetch in a segment, for example an IO segment.
+ */
+extern void zpu_cost_set_segment( zpu_mem_t* zpu_mem_seg, zpu_t* zpu, uint32_t cycles )
+{
+    zpu_mem_seg->cost = cycles;
+    zpu_mem_seg->meter = cycles ? &zpu->cycles : NULL;
+}
+
+/**
+ * @brief Map the cycle counter read-only into the guest, the high word at
+ * virtual_base and the low word at virtual_base+4. The guest view is updated
+ * at each control transfer.
+ */
+extern void zpu_cost_timer_init( zpu_t* zpu, 
+                                 zpu_mem_t* zpu_mem_root, 
+                                 zpu_mem_t* zpu_mem_seg, 
+                                 const char* name, 
+                                 uint32_t virtual_base )
+{
+    zpu_mem_init( zpu_mem_root, 
+                  zpu_mem_seg, 
+                  name, 
+                  zpu->timer, 
+                  virtual_base, 
+                  sizeof(zpu->timer), 
+                  ZPU_MEM_ATTR_RD );
+    zpu_mem_seg->prot_enabled = true;
+}
@@ -0,0 +1,61 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_COST_H
+#define ZPU_COST_H
+
+#include <zpu.h>
+#include <zpu_mem.h>
+
+/** default charges for high level emulated routines, see zpu_hle.h */
+#define ZPU_COST_HLE_CALL       32
+#define ZPU_COST_HLE_WORD       4
+
+/** 
+ * Cycles charged per opcode. Opcode costs are accumulated by zpu_execute()
+ * and committed to zpu_t cycles at each control transfer, where the cycle
+ * budget is checked. Native (HLE) routines are charged hle_call per call
+ * and hle_word per word they move or scan.
+ */
+typedef struct _zpu_cost_
+{
+    uint16_t            opcode[256];
+    uint16_t            hle_call;
+    uint16_t            hle_word;
+} zpu_cost_t;
+
+/** one cycle per instruction, the default after zpu_reset() */
+extern const zpu_cost_t zpu_cost_default;
+
+#define zpu_cost_set_opcode(cost,op,c)          ((cost)->opcode[(op)] = (c))
+#define zpu_cost_get_opcode(cost,op)            ((cost)->opcode[(op)])
+#define zpu_cost_set_hle(cost,call,word)        ((cost)->hle_call = (call), (cost)->hle_word = (word))
+
+extern void zpu_cost_init       ( zpu_cost_t* cost, uint16_t cycles );
+extern void zpu_cost_attach     ( zpu_cost_t* cost, zpu_t* zpu );
+extern void zpu_cost_set_segment( zpu_mem_t* zpu_mem_seg, zpu_t* zpu, uint32_t cycles );
+extern void zpu_cost_timer_init ( zpu_t* zpu, 
+                                  zpu_mem_t* zpu_mem_root, 
+                                  zpu_mem_t* zpu_mem_seg, 
+                                  const char* name, 
+                                  uint32_t virtual_base );
+
+#endif
@@ -0,0 +1,250 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zpu_dedup.h>
+
+#define PAGE_WORDS      (ZPU_MEM_PAGE_SIZE/sizeof(uint32_t))
+
+/** a private page seen once in a pass, merged when a second copy turns up */
+typedef struct _zpu_dedup_candidate_
+{
+    struct _zpu_dedup_candidate_*   next;
+    uint32_t                        hash;
+    zpu_mem_t*                      seg;
+    uint32_t                        page;
+} zpu_dedup_candidate_t;
+
+static uint32_t page_hash( const uint32_t* data );
+static bool     page_zero( const uint32_t* data );
+static void     page_map( zpu_mem_t* zpu_seg, uint32_t page, zpu_dedup_page_t* merged );
+static uint32_t table_reclaim( zpu_dedup_t* dedup );
+
+/**
+ * @brief Initialize a deduplication table shared by many instances.
+ * @param count number of hash buckets.
+ */
+extern bool zpu_dedup_init( zpu_dedup_t* dedup, uint32_t count )
+{
+    dedup->count = count ? count : 1;
+    dedup->pages = 0;
+    dedup->buckets = (zpu_dedup_page_t**)calloc( dedup->count, sizeof(zpu_dedup_page_t*) );
+    return dedup->buckets != NULL;
+}
+
+/**
+ * @brief Free the table, every merged segment must have been released first.
+ */
+extern void zpu_dedup_free( zpu_dedup_t* dedup )
+{
+    for( uint32_t bucket=0; bucket < dedup->count; bucket++ )
+    {
+        zpu_dedup_page_t* merged = dedup->buckets[bucket];
+        while ( merged )
+        {
+            zpu_dedup_page_t* next = merged->next;
+            free( merged );
+            merged = next;
+        }
+    }
+    free( dedup->buckets );
+    dedup->buckets = NULL;
+    dedup->pages = 0;
+}
+
+/**
+ * @brief Merge identical pages of the writable sparse segments of a set of
+ * instances. Pages of zeroes are returned to the host, pages seen before are
+ * mapped to the shared copy and copied again on the next write.
+ * None of the instances may be running, scans of one table must be serialized.
+ * @return the number of host pages released by the pass.
+ */
+extern uint32_t zpu_dedup_scan( zpu_dedup_t* dedup, zpu_mem_t** zpu_mem_roots, uint32_t roots )
+{
+    zpu_dedup_candidate_t** candidates = (zpu_dedup_candidate_t**)calloc( dedup->count, sizeof(zpu_dedup_candidate_t*) );
+    uint32_t saved;
+    if ( candidates == NULL )
+        return 0;
+    saved = table_reclaim( dedup );
+    for( uint32_t root=0; root < roots; root++ )
+    {
+        for( zpu_mem_t* zpu_seg=zpu_mem_roots[root]; zpu_seg; zpu_seg=zpu_seg->next )
+        {
+            uint32_t count = ( zpu_seg->size + ZPU_MEM_PAGE_MASK ) >> ZPU_MEM_PAGE_SHIFT;
+            if ( !zpu_seg->pages || 
+                 ( zpu_mem_get_attr(zpu_seg) & (ZPU_MEM_ATTR_WR|ZPU_MEM_ATTR_IO) ) != ZPU_MEM_ATTR_WR )
+                continue;
+            for( uint32_t page=0; page < count; page++ )
+            {
+                uint32_t* data = (uint32_t*)zpu_seg->pages[page];
+                zpu_dedup_page_t* merged;
+                zpu_dedup_candidate_t** candidate;
+                uint32_t hash;
+                if ( !data || zpu_mem_page_merged( zpu_seg, page ) )
+                    continue;
+                if ( page_zero( data ) )
+                {
+                    free( data );
+                    zpu_seg->pages[page] = NULL;
+                    --zpu_seg->resident;
+                    ++saved;
+                    continue;
+                }
+                hash = page_hash( data );
+                for( merged=dedup->buckets[hash % dedup->count]; merged; merged=merged->next )
+                {
+                    if ( merged->hash == hash && memcmp( merged->data, data, ZPU_MEM_PAGE_SIZE ) == 0 )
+                        break;
+                }
+                if ( merged )
+                {
+                    free( data );
+                    page_map( zpu_seg, page, merged );
+                    ++saved;
+                    continue;
+                }
+                for( candidate=&candidates[hash % dedup->count]; *candidate; candidate=&(*candidate)->next )
+                {
+                    if ( (*candidate)->hash == hash && 
+                         memcmp( (*candidate)->seg->pages[(*candidate)->page], data, ZPU_MEM_PAGE_SIZE ) == 0 )
+                        break;
+                }
+                if ( *candidate )
+                {
+                    zpu_dedup_candidate_t* first = *candidate;
+                    if ( (merged = (zpu_dedup_page_t*)malloc( sizeof(zpu_dedup_page_t) )) == NULL )
+                        continue;
+                    memcpy( merged->data, data, ZPU_MEM_PAGE_SIZE );
+                    merged->hash = hash;
+                    merged->refs = 1;
+                    merged->next = dedup->buckets[hash % dedup->count];
+                    dedup->buckets[hash % dedup->count] = merged;
+                    ++dedup->pages;
+                    free( first->seg->pages[first->page] );
+                    page_map( first->seg, first->page, merged );
+                    free( data );
+                    page_map( zpu_seg, page, merged );
+                    ++saved;
+                    *candidate = first->next;
+                    free( first );
+                }
+                else if ( (*candidate = (zpu_dedup_candidate_t*)malloc( sizeof(zpu_dedup_candidate_t) )) != NULL )
+                {
+                    (*candidate)->next = NULL;
+                    (*candidate)->hash = hash;
+                    (*candidate)->seg = zpu_seg;
+                    (*candidate)->page = page;
+                }
+            }
+        }
+    }
+    for( uint32_t bucket=0; bucket < dedup->count; bucket++ )
+    {
+        while ( candidates[bucket] )
+        {
+            zpu_dedup_candidate_t* next = candidates[bucket]->next;
+            free( candidates[bucket] );
+            candidates[bucket] = next;
+        }
+    }
+    free( candidates );
+    return saved;
+}
+
+/**
+ * @brief Bytes of an instance's memory map served from merged pages.
+ */
+extern uint64_t zpu_dedup_saved( zpu_mem_t* zpu_mem_root )
+{
+    uint64_t saved = 0;
+    for( zpu_mem_t* zpu_seg=zpu_mem_root; zpu_seg; zpu_seg=zpu_seg->next )
+    {
+        saved += zpu_mem_get_merged( zpu_seg );
+    }
+    return saved;
+}
+
+/**
+ * @brief Drop a mapping's reference to a merged page, the table frees it on
+ * the next pass once no mapping is left.
+ */
+extern void zpu_dedup_put( void* data )
+{
+    zpu_dedup_page_t* merged = (zpu_dedup_page_t*)( (uint8_t*)data - offsetof(zpu_dedup_page_t, data) );
+    __atomic_sub_fetch( &merged->refs, 1, __ATOMIC_ACQ_REL );
+}
+
+static void page_map( zpu_mem_t* zpu_seg, uint32_t page, zpu_dedup_page_t* merged )
+{
+    __atomic_add_fetch( &merged->refs, 1, __ATOMIC_ACQ_REL );
+    zpu_seg->pages[page] = merged->data;
+    zpu_seg->merged_map[ page >> 3 ] |= 1 << ( page & 7 );
+    ++zpu_seg->merged;
+    --zpu_seg->resident;
+}
+
+static uint32_t table_reclaim( zpu_dedup_t* dedup )
+{
+    uint32_t freed = 0;
+    for( uint32_t bucket=0; bucket < dedup->count; bucket++ )
+    {
+        for( zpu_dedup_page_t** merged=&dedup->buckets[bucket]; *merged; )
+        {
+            if ( __atomic_load_n( &(*merged)->refs, __ATOMIC_ACQUIRE ) == 1 )
+            {
+                zpu_dedup_page_t* next = (*merged)->next;
+                free( *merged );
+                *merged = next;
+                --dedup->pages;
+                ++freed;
+            }
+            else
+            {
+                merged = &(*merged)->next;
+            }
+        }
+    }
+    return freed;
+}
+
+/** FNV-1a over the page words */
+static uint32_t page_hash( const uint32_t* data )
+{
+    uint32_t hash = 2166136261u;
+    for( uint32_t word=0; word < PAGE_WORDS; word++ )
+    {
+        hash = ( hash ^ data[word] ) * 16777619u;
+    }
+    return hash;
+}
+
+static bool page_zero( const uint32_t* data )
+{
+    for( uint32_t word=0; word < PAGE_WORDS; word++ )
+    {
+        if ( data[word] )
+            return false;
+    }
+    return true;
+}
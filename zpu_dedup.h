@@ -0,0 +1,56 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_DEDUP_H
+#define ZPU_DEDUP_H
+
+#include <zpu_mem.h>
+
+/** 
+ * A read-only host page shared by every sparse segment page with the same
+ * contents. The table holds one reference, each mapping holds another and
+ * drops it on copy on write or release.
+ */
+typedef struct _zpu_dedup_page_
+{
+    struct _zpu_dedup_page_*    next;
+    uint32_t                    hash;
+    uint32_t                    refs;
+    uint8_t                     data[ZPU_MEM_PAGE_SIZE] __attribute__((aligned(16)));
+} zpu_dedup_page_t;
+
+typedef struct _zpu_dedup_
+{
+    zpu_dedup_page_t**  buckets;
+    uint32_t            count;
+    uint32_t            pages;
+} zpu_dedup_t;
+
+/** host bytes held by the table for merged pages */
+#define zpu_dedup_get_size(dedup)               ((dedup)->pages * ZPU_MEM_PAGE_SIZE)
+
+extern bool     zpu_dedup_init  ( zpu_dedup_t* dedup, uint32_t count );
+extern void     zpu_dedup_free  ( zpu_dedup_t* dedup );
+extern uint32_t zpu_dedup_scan  ( zpu_dedup_t* dedup, zpu_mem_t** zpu_mem_roots, uint32_t roots );
+extern uint64_t zpu_dedup_saved ( zpu_mem_t* zpu_mem_root );
+extern void     zpu_dedup_put   ( void* data );
+
+#endif
@@ -0,0 +1,201 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include <zpu_elf.h>
+
+#define ELF_CLASS32         1
+#define ELF_DATA_MSB        2
+#define ELF_SHT_SYMTAB      2
+#define ELF_STT_NOTYPE      0
+#define ELF_STT_OBJECT      1
+#define ELF_STT_FUNC        2
+#define ELF_STB_LOCAL       0
+#define ELF_SHDR_SIZE       40
+#define ELF_SYM_SIZE        16
+
+static uint32_t elf_get32( const uint8_t* p, bool msb );
+static uint16_t elf_get16( const uint8_t* p, bool msb );
+static int      elf_sym_compare( const void* a, const void* b );
+static bool     elf_in_image( uint64_t offset, uint64_t size, long image_size );
+
+/**
+ * @brief Load the function symbols of a 32 bit ELF image (ZPU images are big endian).
+ * @return true on success, the symbol table is sorted by address.
+ */
+extern bool zpu_elf_load_symbols( zpu_elf_t* elf, const char* path )
+{
+    bool rc = false;
+    uint8_t* image = NULL;
+    long image_size;
+    FILE* fp;
+
+    elf->syms = NULL;
+    elf->count = 0;
+    elf->strtab = NULL;
+
+    if ( (fp = fopen( path, "rb" )) == NULL )
+        return false;
+
+    if ( fseek( fp, 0, SEEK_END ) == 0 && (image_size = ftell( fp )) > 0x34 && fseek( fp, 0, SEEK_SET ) == 0 )
+    {
+        if ( (image = (uint8_t*)malloc( image_size )) != NULL && fread( image, 1, image_size, fp ) == (size_t)image_size )
+        {
+            if ( memcmp( image, "\177ELF", 4 ) == 0 && image[4] == ELF_CLASS32 )
+            {
+                bool msb = ( image[5] == ELF_DATA_MSB );
+                uint32_t shoff = elf_get32( &image[0x20], msb );
+                uint16_t shnum = elf_get16( &image[0x30], msb );
+
+                for( uint16_t n=0; n < shnum && !rc; n++ )
+                {
+                    const uint8_t* shdr;
+                    if ( !elf_in_image( shoff, (uint64_t)(n+1) * ELF_SHDR_SIZE, image_size ) )
+                        break;
+                    shdr = &image[ shoff + n * ELF_SHDR_SIZE ];
+                    if ( elf_get32( &shdr[4], msb ) == ELF_SHT_SYMTAB )
+                    {
+                        uint32_t sym_off  = elf_get32( &shdr[16], msb );
+                        uint32_t sym_size = elf_get32( &shdr[20], msb );
+                        uint32_t link     = elf_get32( &shdr[24], msb );
+                        const uint8_t* strhdr;
+                        uint32_t str_off;
+                        uint32_t str_size;
+
+                        if ( link >= shnum || !elf_in_image( shoff, (uint64_t)(link+1) * ELF_SHDR_SIZE, image_size ) )
+                            break;
+                        strhdr   = &image[ shoff + link * ELF_SHDR_SIZE ];
+                        str_off  = elf_get32( &strhdr[16], msb );
+                        str_size = elf_get32( &strhdr[20], msb );
+                        if ( !elf_in_image( sym_off, sym_size, image_size ) || !elf_in_image( str_off, str_size, image_size ) )
+                            break;
+
+                        elf->strtab = (char*)malloc( str_size + 1 );
+                        elf->syms = (zpu_sym_t*)calloc( sym_size / ELF_SYM_SIZE + 1, sizeof(zpu_sym_t) );
+                        if ( elf->strtab && elf->syms )
+                        {
+                            memcpy( elf->strtab, &image[str_off], str_size );
+                            elf->strtab[str_size] = '\0';
+                            for( uint32_t offset=0; offset + ELF_SYM_SIZE <= sym_size; offset += ELF_SYM_SIZE )
+                            {
+                                const uint8_t* sym = &image[ sym_off + offset ];
+                                uint32_t name = elf_get32( &sym[0], msb );
+                                uint8_t type = sym[12] & 0x0F;
+                                bool global_data = ( type == ELF_STT_OBJECT || type == ELF_STT_NOTYPE ) && 
+                                                   (sym[12] >> 4) != ELF_STB_LOCAL && elf_get16( &sym[14], msb ) != 0;
+                                if ( ( type == ELF_STT_FUNC || global_data ) && name < str_size && elf->strtab[name] )
+                                {
+                                    zpu_sym_t* zpu_sym = &elf->syms[elf->count++];
+                                    zpu_sym->addr = elf_get32( &sym[4], msb );
+                                    zpu_sym->size = elf_get32( &sym[8], msb );
+                                    zpu_sym->name = &elf->strtab[name];
+                                    zpu_sym->func = ( type == ELF_STT_FUNC );
+                                }
+                            }
+                            qsort( elf->syms, elf->count, sizeof(zpu_sym_t), elf_sym_compare );
+                            rc = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    free( image );
+    fclose( fp );
+    if ( !rc )
+        zpu_elf_free( elf );
+    return rc;
+}
+
+extern void zpu_elf_free( zpu_elf_t* elf )
+{
+    free( elf->syms );
+    free( elf->strtab );
+    elf->syms = NULL;
+    elf->strtab = NULL;
+    elf->count = 0;
+}
+
+/**
+ * @brief Find the function containing addr, data symbols are skipped.
+ * @return the symbol or NULL.
+ */
+extern const zpu_sym_t* zpu_elf_lookup_addr( const zpu_elf_t* elf, uint32_t addr )
+{
+    uint32_t lo = 0;
+    uint32_t hi = elf->count;
+    while ( lo < hi )
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ( elf->syms[mid].addr <= addr )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    while ( lo > 0 && !elf->syms[lo-1].func )
+        --lo;
+    if ( lo > 0 )
+    {
+        const zpu_sym_t* zpu_sym = &elf->syms[lo-1];
+        if ( zpu_sym->size == 0 || addr < zpu_sym->addr + zpu_sym->size )
+            return zpu_sym;
+    }
+    return NULL;
+}
+
+extern const zpu_sym_t* zpu_elf_lookup_name( const zpu_elf_t* elf, const char* name )
+{
+    for( uint32_t n=0; n < elf->count; n++ )
+    {
+        if ( strcmp( elf->syms[n].name, name ) == 0 )
+            return &elf->syms[n];
+    }
+    return NULL;
+}
+
+static uint32_t elf_get32( const uint8_t* p, bool msb )
+{
+    if ( msb )
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint16_t elf_get16( const uint8_t* p, bool msb )
+{
+    if ( msb )
+        return ((uint16_t)p[0] << 8) | p[1];
+    return ((uint16_t)p[1] << 8) | p[0];
+}
+
+static int elf_sym_compare( const void* a, const void* b )
+{
+    const zpu_sym_t* sa = (const zpu_sym_t*)a;
+    const zpu_sym_t* sb = (const zpu_sym_t*)b;
+    return ( sa->addr > sb->addr ) - ( sa->addr < sb->addr );
+}
+
+/** true when offset..offset+size lies within the image, without overflow */
+static bool elf_in_image( uint64_t offset, uint64_t size, long image_size )
+{
+    return offset <= (uint64_t)image_size && size <= (uint64_t)image_size - offset;
+}
@@ -0,0 +1,58 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_ELF_H
+#define ZPU_ELF_H
+
+#if defined(_CARIBOU_RTOS_)
+    #include <caribou/kernel/types.h> 
+#else
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stdlib.h>
+#endif
+
+/** a function or global data symbol from the guest ELF symbol table */
+typedef struct _zpu_sym_
+{
+    uint32_t            addr;
+    uint32_t            size;
+    const char*         name;
+    bool                func;
+} zpu_sym_t;
+
+typedef struct _zpu_elf_
+{
+    zpu_sym_t*          syms;
+    uint32_t            count;
+    char*               strtab;
+} zpu_elf_t;
+
+#define zpu_elf_get_count(elf)                  ((elf)->count)
+#define zpu_elf_get_sym(elf,n)                  (&(elf)->syms[(n)])
+
+extern bool             zpu_elf_load_symbols( zpu_elf_t* elf, const char* path );
+extern void             zpu_elf_free        ( zpu_elf_t* elf );
+
+extern const zpu_sym_t* zpu_elf_lookup_addr ( const zpu_elf_t* elf, uint32_t addr );
+extern const zpu_sym_t* zpu_elf_lookup_name ( const zpu_elf_t* elf, const char* name );
+
+#endif
@@ -0,0 +1,371 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <string.h>
+
+#include <zpu_hle.h>
+#include <zpu_mem.h>
+#include <zpu_cost.h>
+
+#define HLE_LANE(p,offset)      ((p)[(offset)^0x03])
+
+static zpu_hle_fn_t hle_lookup( zpu_hle_t* hle, uint32_t va );
+static uint32_t     hle_min( uint32_t a, uint32_t b );
+static void         hle_charge( zpu_t* zpu, uint32_t va, uint32_t bytes );
+static bool         hle_mapped( zpu_t* zpu, uint32_t va );
+
+static const struct
+{
+    const char*     name;
+    zpu_hle_fn_t    fn;
+} hle_defaults[] =
+{
+    { "memcpy",     zpu_hle_memcpy  },
+    { "memset",     zpu_hle_memset  },
+    { "strlen",     zpu_hle_strlen  },
+    { "__mulsi3",   zpu_hle_mulsi3  },
+    { "__divsi3",   zpu_hle_divsi3  },
+    { "__modsi3",   zpu_hle_modsi3  },
+    { "__udivsi3",  zpu_hle_udivsi3 },
+    { "__umodsi3",  zpu_hle_umodsi3 },
+    { NULL,         NULL            }
+};
+
+extern void zpu_hle_init( zpu_hle_t* hle )
+{
+    hle->entries = NULL;
+    hle->count = 0;
+    hle->capacity = 0;
+    hle->va_min = 0xFFFFFFFF;
+    hle->va_max = 0;
+    hle->r0 = ZPU_HLE_NO_R0;
+}
+
+extern void zpu_hle_free( zpu_hle_t* hle )
+{
+    free( hle->entries );
+    zpu_hle_init( hle );
+}
+
+/**
+ * @brief Register a native routine for the guest entry address va.
+ * Registering an address twice replaces the routine.
+ */
+extern bool zpu_hle_register( zpu_hle_t* hle, uint32_t va, zpu_hle_fn_t fn )
+{
+    uint32_t n;
+    for( n=0; n < hle->count && hle->entries[n].va < va; n++ );
+    if ( n < hle->count && hle->entries[n].va == va )
+    {
+        hle->entries[n].fn = fn;
+        return true;
+    }
+    if ( hle->count == hle->capacity )
+    {
+        uint32_t capacity = hle->capacity ? hle->capacity * 2 : 16;
+        zpu_hle_entry_t* entries = (zpu_hle_entry_t*)realloc( hle->entries, capacity * sizeof(zpu_hle_entry_t) );
+        if ( !entries )
+            return false;
+        hle->entries = entries;
+        hle->capacity = capacity;
+    }
+    memmove( &hle->entries[n+1], &hle->entries[n], (hle->count - n) * sizeof(zpu_hle_entry_t) );
+    hle->entries[n].va = va;
+    hle->entries[n].fn = fn;
+    ++hle->count;
+    if ( va < hle->va_min )
+        hle->va_min = va;
+    if ( va > hle->va_max )
+        hle->va_max = va;
+    return true;
+}
+
+extern bool zpu_hle_register_symbol( zpu_hle_t* hle, const zpu_elf_t* elf, const char* name, zpu_hle_fn_t fn )
+{
+    const zpu_sym_t* zpu_sym = zpu_elf_lookup_name( elf, name );
+    if ( zpu_sym )
+        return zpu_hle_register( hle, zpu_sym->addr, fn );
+    return false;
+}
+
+/**
+ * @brief Register the built in routines for each one found in the guest symbol
+ * table, R0 is taken from the _memreg symbol.
+ * @return the number of routines registered.
+ */
+extern uint32_t zpu_hle_register_defaults( zpu_hle_t* hle, const zpu_elf_t* elf )
+{
+    const zpu_sym_t* memreg = zpu_elf_lookup_name( elf, ZPU_HLE_MEMREG );
+    uint32_t count = 0;
+    if ( memreg )
+        zpu_hle_set_r0( hle, memreg->addr );
+    for( int n=0; hle_defaults[n].name; n++ )
+    {
+        if ( zpu_hle_register_symbol( hle, elf, hle_defaults[n].name, hle_defaults[n].fn ) )
+            ++count;
+    }
+    return count;
+}
+
+/**
+ * @brief Enable high level emulation on an instance, must follow zpu_reset().
+ */
+extern void zpu_hle_attach( zpu_hle_t* hle, zpu_t* zpu )
+{
+    zpu->hle = hle;
+}
+
+extern void zpu_hle_detach( zpu_t* zpu )
+{
+    zpu->hle = NULL;
+}
+
+/**
+ * @brief Called by zpu_execute() following ZPU_CALL and ZPU_CALLPCREL.
+ * On entry tos holds the return address and the arguments follow on the
+ * guest stack. The native routine result is stored to R0 and the call
+ * is returned as by ZPU_POPPC. The call is charged hle_call cycles from the
+ * instance cost table, routines charge the memory they touch.
+ * @return true if pc was a registered routine, never while R0 is unknown.
+ */
+extern bool zpu_hle_call( zpu_hle_t* hle, zpu_t* zpu )
+{
+    zpu_hle_fn_t fn;
+    if ( zpu_get_pc(zpu) < hle->va_min || zpu_get_pc(zpu) > hle->va_max || hle->r0 == ZPU_HLE_NO_R0 )
+        return false;
+    if ( (fn = hle_lookup( hle, zpu_get_pc(zpu) )) == NULL )
+        return false;
+    zpu->cycles += zpu->cost->hle_call;
+    zpu_mem_set_uint32( zpu_get_mem(zpu), hle->r0, fn( zpu ) );
+    zpu_set_pc( zpu, zpu_get_tos(zpu) );
+    zpu_inc_sp( zpu );
+    zpu_set_tos( zpu, zpu_mem_get_uint32( zpu_get_mem(zpu), zpu_get_sp(zpu) ) );
+    return true;
+}
+
+/* void* memcpy( void* dst, const void* src, size_t n ) */
+extern uint32_t zpu_hle_memcpy( zpu_t* zpu )
+{
+    zpu_mem_t* zpu_mem = zpu_get_mem(zpu);
+    uint32_t dst = zpu_hle_arg( zpu, 0 );
+    uint32_t d = dst;
+    uint32_t s = zpu_hle_arg( zpu, 1 );
+    uint32_t n = zpu_hle_arg( zpu, 2 );
+    while ( n )
+    {
+        uint32_t d_avail, s_avail, chunk, d_off, s_off, k=0;
+        uint8_t* dp = zpu_mem_direct( zpu_mem, d, &d_avail, ZPU_MEM_ATTR_WR );
+        uint8_t* sp = zpu_mem_direct( zpu_mem, s, &s_avail, ZPU_MEM_ATTR_RD );
+        if ( !dp || !sp )
+        {
+            if ( !hle_mapped( zpu, d ) || !hle_mapped( zpu, s ) )
+            {
+                zpu_mem_set_uint8( zpu_mem, d, zpu_mem_get_uint8( zpu_mem, s ) );
+                break;
+            }
+            zpu_mem_set_uint8( zpu_mem, d++, zpu_mem_get_uint8( zpu_mem, s++ ) );
+            zpu->cycles += zpu->cost->hle_word;
+            --n;
+            continue;
+        }
+        chunk = hle_min( n, hle_min( d_avail, s_avail ) );
+        hle_charge( zpu, d, chunk );
+        hle_charge( zpu, s, chunk );
+        d_off = d & 0x03;
+        s_off = s & 0x03;
+        if ( d_off == s_off )
+        {
+            uint32_t words;
+            for( ; k < chunk && ((d_off + k) & 0x03); k++ )
+                HLE_LANE( dp, d_off + k ) = HLE_LANE( sp, s_off + k );
+            words = (chunk - k) & ~0x03;
+            memmove( dp + d_off + k, sp + s_off + k, words );
+            k += words;
+        }
+        for( ; k < chunk; k++ )
+            HLE_LANE( dp, d_off + k ) = HLE_LANE( sp, s_off + k );
+        d += chunk;
+        s += chunk;
+        n -= chunk;
+    }
+    return dst;
+}
+
+/* void* memset( void* dst, int c, size_t n ) */
+extern uint32_t zpu_hle_memset( zpu_t* zpu )
+{
+    zpu_mem_t* zpu_mem = zpu_get_mem(zpu);
+    uint32_t dst = zpu_hle_arg( zpu, 0 );
+    uint8_t  c = zpu_hle_arg( zpu, 1 ) & 0xFF;
+    uint32_t n = zpu_hle_arg( zpu, 2 );
+    uint32_t d = dst;
+    while ( n )
+    {
+        uint32_t d_avail, chunk, d_off, words, k=0;
+        uint8_t* dp = zpu_mem_direct( zpu_mem, d, &d_avail, ZPU_MEM_ATTR_WR );
+        if ( !dp )
+        {
+            if ( !hle_mapped( zpu, d ) )
+            {
+                zpu_mem_set_uint8( zpu_mem, d, c );
+                break;
+            }
+            zpu_mem_set_uint8( zpu_mem, d++, c );
+            zpu->cycles += zpu->cost->hle_word;
+            --n;
+            continue;
+        }
+        chunk = hle_min( n, d_avail );
+        hle_charge( zpu, d, chunk );
+        d_off = d & 0x03;
+        for( ; k < chunk && ((d_off + k) & 0x03); k++ )
+            HLE_LANE( dp, d_off + k ) = c;
+        words = (chunk - k) & ~0x03;
+        memset( dp + d_off + k, c, words );
+        for( k += words; k < chunk; k++ )
+            HLE_LANE( dp, d_off + k ) = c;
+        d += chunk;
+        n -= chunk;
+    }
+    return dst;
+}
+
+/* size_t strlen( const char* s ) */
+extern uint32_t zpu_hle_strlen( zpu_t* zpu )
+{
+    zpu_mem_t* zpu_mem = zpu_get_mem(zpu);
+    uint32_t s = zpu_hle_arg( zpu, 0 );
+    uint32_t n = 0;
+    for(;;)
+    {
+        uint32_t s_avail, s_off, k;
+        uint8_t* sp = zpu_mem_direct( zpu_mem, s + n, &s_avail, ZPU_MEM_ATTR_RD );
+        if ( !sp )
+        {
+            /* an unterminated string ends at the first fault */
+            if ( zpu_mem_get_uint8( zpu_mem, s + n ) == 0 || !hle_mapped( zpu, s + n ) )
+                return n;
+            zpu->cycles += zpu->cost->hle_word;
+            ++n;
+            continue;
+        }
+        s_off = (s + n) & 0x03;
+        for( k=0; k < s_avail && HLE_LANE( sp, s_off + k ) != 0; k++ );
+        hle_charge( zpu, s + n, k + 1 );
+        n += k;
+        if ( k < s_avail )
+            return n;
+    }
+}
+
+extern uint32_t zpu_hle_mulsi3( zpu_t* zpu )
+{
+    return zpu_hle_arg( zpu, 0 ) * zpu_hle_arg( zpu, 1 );
+}
+
+extern uint32_t zpu_hle_divsi3( zpu_t* zpu )
+{
+    int32_t a = (int32_t)zpu_hle_arg( zpu, 0 );
+    int32_t b = (int32_t)zpu_hle_arg( zpu, 1 );
+    if ( b == 0 )
+    {
+        zpu_divzero_handler( zpu );
+        return 0;
+    }
+    if ( b == -1 )
+        return -(uint32_t)a;
+    return (uint32_t)(a / b);
+}
+
+extern uint32_t zpu_hle_modsi3( zpu_t* zpu )
+{
+    int32_t a = (int32_t)zpu_hle_arg( zpu, 0 );
+    int32_t b = (int32_t)zpu_hle_arg( zpu, 1 );
+    if ( b == 0 )
+    {
+        zpu_divzero_handler( zpu );
+        return 0;
+    }
+    if ( b == -1 )
+        return 0;
+    return (uint32_t)(a % b);
+}
+
+extern uint32_t zpu_hle_udivsi3( zpu_t* zpu )
+{
+    uint32_t a = zpu_hle_arg( zpu, 0 );
+    uint32_t b = zpu_hle_arg( zpu, 1 );
+    if ( b == 0 )
+    {
+        zpu_divzero_handler( zpu );
+        return 0;
+    }
+    return a / b;
+}
+
+extern uint32_t zpu_hle_umodsi3( zpu_t* zpu )
+{
+    uint32_t a = zpu_hle_arg( zpu, 0 );
+    uint32_t b = zpu_hle_arg( zpu, 1 );
+    if ( b == 0 )
+    {
+        zpu_divzero_handler( zpu );
+        return 0;
+    }
+    return a % b;
+}
+
+static zpu_hle_fn_t hle_lookup( zpu_hle_t* hle, uint32_t va )
+{
+    uint32_t lo = 0;
+    uint32_t hi = hle->count;
+    while ( lo < hi )
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if ( hle->entries[mid].va == va )
+            return hle->entries[mid].fn;
+        if ( hle->entries[mid].va < va )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+static uint32_t hle_min( uint32_t a, uint32_t b )
+{
+    return a < b ? a : b;
+}
+
+/** charge a direct transfer of bytes at va, per word and at the segment cost */
+static void hle_charge( zpu_t* zpu, uint32_t va, uint32_t bytes )
+{
+    zpu_mem_t* zpu_seg = zpu_mem_lookup( zpu_get_mem(zpu), va );
+    uint32_t words = ( bytes + 3 ) >> 2;
+    zpu->cycles += (uint64_t)words * zpu->cost->hle_word;
+    if ( zpu_seg && zpu_seg->meter )
+        *zpu_seg->meter += (uint64_t)words * zpu_seg->cost;
+}
+
+static bool hle_mapped( zpu_t* zpu, uint32_t va )
+{
+    return zpu_mem_lookup( zpu_get_mem(zpu), va ) != NULL;
+}
@@ -0,0 +1,80 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_HLE_H
+#define ZPU_HLE_H
+
+#include <zpu.h>
+#include <zpu_elf.h>
+
+/** the guest pseudo registers, R0 holds return values */
+#define ZPU_HLE_MEMREG          "_memreg"
+#define ZPU_HLE_NO_R0           0xFFFFFFFF
+
+#define zpu_hle_arg(zpu,n)      zpu_mem_get_uint32( zpu_get_mem(zpu), zpu_get_sp(zpu) + 4 + (n) * 4 )
+
+/** a native implementation of a guest routine, returns the value for R0 */
+typedef uint32_t (*zpu_hle_fn_t)( zpu_t* zpu );
+
+typedef struct _zpu_hle_entry_
+{
+    uint32_t            va;
+    zpu_hle_fn_t        fn;
+} zpu_hle_entry_t;
+
+/**
+ * High level emulation registry, maps guest routine entry addresses
+ * to native host implementations called in place of the guest code.
+ */
+typedef struct _zpu_hle_
+{
+    zpu_hle_entry_t*    entries;
+    uint32_t            count;
+    uint32_t            capacity;
+    uint32_t            va_min;
+    uint32_t            va_max;
+    uint32_t            r0;
+} zpu_hle_t;
+
+/** set the address of R0, calls are not intercepted until it is known */
+#define zpu_hle_set_r0(hle,va)  ((hle)->r0 = (va))
+#define zpu_hle_get_r0(hle)     ((hle)->r0)
+
+extern void     zpu_hle_init             ( zpu_hle_t* hle );
+extern void     zpu_hle_free             ( zpu_hle_t* hle );
+extern bool     zpu_hle_register         ( zpu_hle_t* hle, uint32_t va, zpu_hle_fn_t fn );
+extern bool     zpu_hle_register_symbol  ( zpu_hle_t* hle, const zpu_elf_t* elf, const char* name, zpu_hle_fn_t fn );
+extern uint32_t zpu_hle_register_defaults( zpu_hle_t* hle, const zpu_elf_t* elf );
+extern void     zpu_hle_attach           ( zpu_hle_t* hle, zpu_t* zpu );
+extern void     zpu_hle_detach           ( zpu_t* zpu );
+extern bool     zpu_hle_call             ( zpu_hle_t* hle, zpu_t* zpu );
+
+/** native implementations of common newlib and libgcc routines */
+extern uint32_t zpu_hle_memcpy  ( zpu_t* zpu );
+extern uint32_t zpu_hle_memset  ( zpu_t* zpu );
+extern uint32_t zpu_hle_strlen  ( zpu_t* zpu );
+extern uint32_t zpu_hle_mulsi3  ( zpu_t* zpu );
+extern uint32_t zpu_hle_divsi3  ( zpu_t* zpu );
+extern uint32_t zpu_hle_modsi3  ( zpu_t* zpu );
+extern uint32_t zpu_hle_udivsi3 ( zpu_t* zpu );
+extern uint32_t zpu_hle_umodsi3 ( zpu_t* zpu );
+
+#endif
@@ -19,11 +19,21 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
  * DEALINGS IN THE SOFTWARE.
  ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+
 #include <zpu_mem.h>
+#include <zpu_watch.h>
+#include <zpu_dedup.h>
 
 static void         zpu_mem_append( zpu_mem_t* zpu_mem_root, zpu_mem_t* zpu_mem_seg );
 static zpu_mem_t*   zpu_mem_seg_v( zpu_mem_t* zpu_mem_root, uint32_t va );
 static void*        zpu_va_to_pa( zpu_mem_t* zpu_mem, uint32_t va );
+static void*        zpu_va_to_pa_wr( zpu_mem_t* zpu_mem, uint32_t va );
+static uint8_t      zpu_mem_load_uint8( zpu_mem_t* zpu_seg, uint32_t va );
+
+/** backs every untouched page of every sparse segment */
+static const uint32_t zpu_mem_zero_page[ZPU_MEM_PAGE_SIZE/sizeof(uint32_t)];
 
 
 extern void zpu_mem_init( zpu_mem_t* zpu_mem_root, 
@@ -47,6 +57,135 @@ extern void zpu_mem_init( zpu_mem_t* zpu_mem_root,
         zpu_mem_seg->size = size;
         zpu_mem_seg->attr = attr;
         zpu_mem_seg->prot_enabled = false;
+        zpu_mem_seg->share = NULL;
+        zpu_mem_seg->pages = NULL;
+        zpu_mem_seg->resident = 0;
+        zpu_mem_seg->watch = NULL;
+        zpu_mem_seg->watch_map = NULL;
+        zpu_mem_seg->watch_ex = 0;
+        zpu_mem_seg->cost = 0;
+        zpu_mem_seg->meter = NULL;
+        zpu_mem_seg->merged_map = NULL;
+        zpu_mem_seg->merged = 0;
+    }
+}
+
+/**
+ * @brief Prepare a host buffer for sharing between instances.
+ */
+extern void zpu_mem_share_init( zpu_mem_share_t* share,
+                                void* physical_base,
+                                uint32_t size )
+{
+    share->physical_base = physical_base;
+    share->size = size;
+    share->refs = 0;
+}
+
+/**
+ * @brief Link a shared buffer into an instance memory map as a read-only segment.
+ * Shared segments remain write protected regardless of zpu_mem_set_prot().
+ */
+extern void zpu_mem_init_shared( zpu_mem_t* zpu_mem_root, 
+                                 zpu_mem_t* zpu_mem_seg, 
+                                 const char* name, 
+                                 zpu_mem_share_t* share, 
+                                 uint32_t virtual_base, 
+                                 uint8_t attr )
+{
+    zpu_mem_init( zpu_mem_root, 
+                  zpu_mem_seg, 
+                  name, 
+                  share->physical_base, 
+                  virtual_base, 
+                  share->size, 
+                  attr & ~ZPU_MEM_ATTR_WR );
+    zpu_mem_seg->share = share;
+    zpu_mem_seg->prot_enabled = true;
+    __atomic_add_fetch( &share->refs, 1, __ATOMIC_ACQ_REL );
+}
+
+/**
+ * @brief Drop an instance reference to a shared segment.
+ * @return the remaining reference count, the buffer may be freed when zero.
+ */
+extern uint32_t zpu_mem_release( zpu_mem_t* zpu_mem_seg )
+{
+    zpu_mem_share_t* share = zpu_mem_seg->share;
+    if ( share )
+    {
+        zpu_mem_seg->share = NULL;
+        return __atomic_sub_fetch( &share->refs, 1, __ATOMIC_ACQ_REL );
+    }
+    return 0;
+}
+
+/**
+ * @brief Initialize a demand paged segment with no physical buffer.
+ * Pages are allocated on first write, reads of untouched pages return zero.
+ * @return false if the page table could not be allocated.
+ */
+extern bool zpu_mem_init_sparse( zpu_mem_t* zpu_mem_root, 
+                                 zpu_mem_t* zpu_mem_seg, 
+                                 const char* name, 
+                                 uint32_t virtual_base, 
+                                 uint32_t size,
+                                 uint8_t attr )
+{
+    uint32_t count = (size + ZPU_MEM_PAGE_MASK) >> ZPU_MEM_PAGE_SHIFT;
+    void** pages = (void**)calloc( count, sizeof(void*) );
+    uint8_t* merged_map = (uint8_t*)calloc( (count + 7) >> 3, 1 );
+    if ( pages && merged_map )
+    {
+        zpu_mem_init( zpu_mem_root, zpu_mem_seg, name, NULL, virtual_base, size, attr );
+        zpu_mem_seg->pages = pages;
+        zpu_mem_seg->merged_map = merged_map;
+        return true;
+    }
+    free( pages );
+    free( merged_map );
+    return false;
+}
+
+/**
+ * @brief Return the pages wholly within va..va+size of a sparse segment to the host,
+ * they read as zero until written again.
+ */
+extern void zpu_mem_sparse_release( zpu_mem_t* zpu_mem_seg, uint32_t va, uint32_t size )
+{
+    if ( zpu_mem_seg->pages && va >= zpu_mem_seg->virtual_base )
+    {
+        uint32_t first = ( va - zpu_mem_seg->virtual_base + ZPU_MEM_PAGE_MASK ) >> ZPU_MEM_PAGE_SHIFT;
+        uint32_t last  = ( va - zpu_mem_seg->virtual_base + size ) >> ZPU_MEM_PAGE_SHIFT;
+        uint32_t count = ( zpu_mem_seg->size + ZPU_MEM_PAGE_MASK ) >> ZPU_MEM_PAGE_SHIFT;
+        for( uint32_t page=first; page < last && page < count; page++ )
+        {
+            if ( zpu_mem_seg->pages[page] && zpu_mem_page_merged( zpu_mem_seg, page ) )
+            {
+                zpu_dedup_put( zpu_mem_seg->pages[page] );
+                zpu_mem_seg->pages[page] = NULL;
+                zpu_mem_seg->merged_map[ page >> 3 ] &= ~( 1 << ( page & 7 ) );
+                --zpu_mem_seg->merged;
+            }
+            else if ( zpu_mem_seg->pages[page] )
+            {
+                free( zpu_mem_seg->pages[page] );
+                zpu_mem_seg->pages[page] = NULL;
+                --zpu_mem_seg->resident;
+            }
+        }
+    }
+}
+
+extern void zpu_mem_sparse_free( zpu_mem_t* zpu_mem_seg )
+{
+    if ( zpu_mem_seg->pages )
+    {
+        zpu_mem_sparse_release( zpu_mem_seg, zpu_mem_seg->virtual_base, zpu_mem_seg->size );
+        free( zpu_mem_seg->pages );
+        free( zpu_mem_seg->merged_map );
+        zpu_mem_seg->pages = NULL;
+        zpu_mem_seg->merged_map = NULL;
     }
 }
 
@@ -54,8 +193,92 @@ extern void zpu_mem_set_prot( zpu_mem_t* zpu_mem, bool enabled )
 {
     for(zpu_mem_t* next=zpu_mem; next; next=next->next)
     {
-        next->prot_enabled = enabled;
+        next->prot_enabled = enabled || next->share;
+    }
+}
+
+/**
+ * @brief Find the segment mapping va without raising a segmentation fault.
+ * @return the segment or NULL.
+ */
+extern zpu_mem_t* zpu_mem_lookup( zpu_mem_t* zpu_mem_root, uint32_t va )
+{
+    return zpu_mem_seg_v( zpu_mem_root, va );
+}
+
+/**
+ * @brief Direct host access for bulk transfers, bypasses the override callbacks.
+ * @param access ZPU_MEM_ATTR_RD and/or ZPU_MEM_ATTR_WR
+ * @param avail receives the number of bytes from va to the end of the mapping,
+ * or to the first page holding a watchpoint.
+ * @return host address of the word containing va (bytes within the word are
+ * lane swizzled), or NULL when va is not in a plain accessible segment or
+ * lies in a watched page.
+ */
+extern uint8_t* zpu_mem_direct( zpu_mem_t* zpu_mem_root, uint32_t va, uint32_t* avail, uint8_t access )
+{
+    zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem_root, va );
+    if ( zpu_seg && !(zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_IO) && !zpu_mem_watched( zpu_seg, va ) )
+    {
+        if ( (access & ZPU_MEM_ATTR_WR) && zpu_seg->share )
+            return NULL;
+        if ( ( zpu_mem_get_attr(zpu_seg) & access ) == access || !zpu_seg->prot_enabled )
+        {
+            *avail = zpu_seg->virtual_base + zpu_seg->size - va;
+            if ( zpu_seg->pages )
+            {
+                uint32_t page_avail = ZPU_MEM_PAGE_SIZE - ( (va - zpu_seg->virtual_base) & ZPU_MEM_PAGE_MASK );
+                if ( page_avail < *avail )
+                    *avail = page_avail;
+            }
+            if ( zpu_seg->watch_map )
+            {
+                /* stop short of the first page holding a watched range */
+                uint32_t delta = va - zpu_seg->virtual_base;
+                for( uint32_t page=(delta >> ZPU_MEM_PAGE_SHIFT) + 1; (page << ZPU_MEM_PAGE_SHIFT) - delta < *avail; page++ )
+                {
+                    if ( zpu_seg->watch_map[ page >> 3 ] & ( 1 << (page & 7) ) )
+                    {
+                        *avail = (page << ZPU_MEM_PAGE_SHIFT) - delta;
+                        break;
+                    }
+                }
+            }
+            if ( access & ZPU_MEM_ATTR_WR )
+                return (uint8_t*)zpu_va_to_pa_wr( zpu_seg, va & ~0x03 );
+            return (uint8_t*)zpu_va_to_pa( zpu_seg, va & ~0x03 );
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Read guest memory for the host without side effects, the override
+ * callbacks, watchpoints and cycle metering are bypassed and IO segments refused.
+ * @return false when va is not in a readable segment.
+ */
+extern bool zpu_mem_peek_uint32( zpu_mem_t* zpu_mem_root, uint32_t va, uint32_t* value )
+{
+    zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem_root, va );
+    if ( zpu_seg && !(zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_IO) && 
+         ( (zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_RD) || !zpu_seg->prot_enabled ) )
+    {
+        *value = *(uint32_t*)zpu_va_to_pa( zpu_seg, va & ~0x03 );
+        return true;
     }
+    return false;
+}
+
+extern bool zpu_mem_peek_uint8( zpu_mem_t* zpu_mem_root, uint32_t va, uint8_t* value )
+{
+    zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem_root, va );
+    if ( zpu_seg && !(zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_IO) && 
+         ( (zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_RD) || !zpu_seg->prot_enabled ) )
+    {
+        *value = *(uint8_t*)zpu_va_to_pa( zpu_seg, va ^ 0x03 );
+        return true;
+    }
+    return false;
 }
 
 extern uint32_t zpu_mem_get_uint32( zpu_mem_t* zpu_mem, uint32_t va )
@@ -63,17 +286,20 @@ extern uint32_t zpu_mem_get_uint32( zpu_mem_t* zpu_mem, uint32_t va )
     zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem, va );
     if ( zpu_seg && ( ( zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_RD ) || !zpu_seg->prot_enabled ) )
     {
+        zpu_mem_charge( zpu_seg );
         uint32_t value;
-        if ( zpu_mem_override_get_uint32 ( zpu_seg, va, &value ) )
-        {
-            return value;
-        }
-        else
+        if ( !zpu_mem_override_get_uint32 ( zpu_seg, va, &value ) )
         {
             void* pa = zpu_va_to_pa( zpu_seg, va );
             uint32_t* p = (uint32_t*)pa;
-            return *p;
+            if ( zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_SYNC )
+                value = __atomic_load_n( p, __ATOMIC_ACQUIRE );
+            else
+                value = *p;
         }
+        if ( zpu_mem_watched( zpu_seg, va ) )
+            zpu_watch_check( zpu_seg, va, sizeof(value), ZPU_MEM_ATTR_RD, value );
+        return value;
     }
     zpu_segv_handler( zpu_mem, va );
     return ZPU_MEM_BAD;
@@ -84,17 +310,17 @@ extern uint16_t zpu_mem_get_uint16( zpu_mem_t* zpu_mem, uint32_t va )
     zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem, va );
     if ( zpu_seg && ( ( zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_RD ) || !zpu_seg->prot_enabled ) )
     {
+        zpu_mem_charge( zpu_seg );
         uint16_t value;
-        if ( zpu_mem_override_get_uint16 ( zpu_seg, va, &value ) )
-        {
-            return value;
-        }
-        else
+        if ( !zpu_mem_override_get_uint16 ( zpu_seg, va, &value ) )
         {
             void* pa = zpu_va_to_pa( zpu_seg, va ^ 0x02 );
             uint16_t* p = (uint16_t*)pa;
-            return *p;
+            value = *p;
         }
+        if ( zpu_mem_watched( zpu_seg, va ) )
+            zpu_watch_check( zpu_seg, va, sizeof(value), ZPU_MEM_ATTR_RD, value );
+        return value;
     }
     zpu_segv_handler( zpu_mem, va );
     return ZPU_MEM_BAD&0xFFFF;
@@ -105,17 +331,11 @@ extern uint8_t zpu_mem_get_uint8( zpu_mem_t* zpu_mem, uint32_t va )
     zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem, va );
     if ( zpu_seg && ( ( zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_RD ) || !zpu_seg->prot_enabled ) )
     {
-        uint8_t value;
-        if ( zpu_mem_override_get_uint8 ( zpu_seg, va, &value ) )
-        {
-            return value;
-        }
-        else
-        {
-            void* pa = zpu_va_to_pa( zpu_seg, va ^ 0x03 );
-            uint8_t* p = (uint8_t*)pa;
-            return *p;
-        }
+        zpu_mem_charge( zpu_seg );
+        uint8_t value = zpu_mem_load_uint8( zpu_seg, va );
+        if ( zpu_mem_watched( zpu_seg, va ) )
+            zpu_watch_check( zpu_seg, va, sizeof(value), ZPU_MEM_ATTR_RD, value );
+        return value;
     }
     zpu_segv_handler( zpu_mem, va );
     return ZPU_MEM_BAD&0xFF;
@@ -124,10 +344,15 @@ extern uint8_t zpu_mem_get_uint8( zpu_mem_t* zpu_mem, uint32_t va )
 extern uint8_t zpu_mem_get_opcode( zpu_mem_t* zpu_mem, uint32_t va )
 {
     zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem, va );
-    if ( ((zpu_mem_get_attr(zpu_seg) & (ZPU_MEM_ATTR_RD|ZPU_MEM_ATTR_EX)) ==  (ZPU_MEM_ATTR_RD|ZPU_MEM_ATTR_EX)) || !zpu_seg->prot_enabled )
+    if ( zpu_seg && ( ((zpu_mem_get_attr(zpu_seg) & (ZPU_MEM_ATTR_RD|ZPU_MEM_ATTR_EX)) ==  (ZPU_MEM_ATTR_RD|ZPU_MEM_ATTR_EX)) || !zpu_seg->prot_enabled ) )
     {
+        zpu_mem_charge( zpu_seg );
+        uint8_t opcode;
         zpu_opcode_fetch_notify( zpu_seg, va );
-        return zpu_mem_get_uint8( zpu_seg, va );
+        opcode = zpu_mem_load_uint8( zpu_seg, va );
+        if ( zpu_mem_watched( zpu_seg, va ) )
+            zpu_watch_check( zpu_seg, va, sizeof(opcode), ZPU_MEM_ATTR_EX, opcode );
+        return opcode;
     }
     zpu_segv_handler( zpu_mem, va );
     return ZPU_MEM_BAD&0xFF;
@@ -139,12 +364,23 @@ extern void zpu_mem_set_uint32( zpu_mem_t* zpu_mem, uint32_t va, uint32_t w )
     zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem, va );
     if ( zpu_seg && ( ( zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_WR ) || !zpu_seg->prot_enabled ) )
     {
+        zpu_mem_charge( zpu_seg );
         if ( !zpu_mem_override_set_uint32 ( zpu_seg, va, w ) )
         {
-            void* pa = zpu_va_to_pa( zpu_seg, va );
+            void* pa = zpu_va_to_pa_wr( zpu_seg, va );
             uint32_t* p = (uint32_t*)pa;
-            *p = w;
+            if ( !p )
+            {
+                zpu_segv_handler( zpu_mem, va );
+                return;
+            }
+            if ( zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_SYNC )
+                __atomic_store_n( p, w, __ATOMIC_RELEASE );
+            else
+                *p = w;
         }
+        if ( zpu_mem_watched( zpu_seg, va ) )
+            zpu_watch_check( zpu_seg, va, sizeof(w), ZPU_MEM_ATTR_WR, w );
         return;
     }
     zpu_segv_handler( zpu_mem, va );
@@ -155,12 +391,20 @@ extern void zpu_mem_set_uint16( zpu_mem_t* zpu_mem, uint32_t va, uint16_t w )
     zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem, va );
     if ( zpu_seg && ( ( zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_WR ) || !zpu_seg->prot_enabled ) )
     {
+        zpu_mem_charge( zpu_seg );
         if ( !zpu_mem_override_set_uint16 ( zpu_seg, va, w ) )
         {
-            void* pa = zpu_va_to_pa( zpu_seg, va ^ 0x02 );
+            void* pa = zpu_va_to_pa_wr( zpu_seg, va ^ 0x02 );
             uint16_t* p = (uint16_t*)pa;
+            if ( !p )
+            {
+                zpu_segv_handler( zpu_mem, va );
+                return;
+            }
             *p = w;
         }
+        if ( zpu_mem_watched( zpu_seg, va ) )
+            zpu_watch_check( zpu_seg, va, sizeof(w), ZPU_MEM_ATTR_WR, w );
         return;
     }
     zpu_segv_handler( zpu_mem, va );
@@ -169,14 +413,22 @@ extern void zpu_mem_set_uint16( zpu_mem_t* zpu_mem, uint32_t va, uint16_t w )
 extern void zpu_mem_set_uint8( zpu_mem_t* zpu_mem, uint32_t va, uint8_t w )
 {
     zpu_mem_t* zpu_seg = zpu_mem_seg_v( zpu_mem, va );
-    if ( zpu_seg && ( ( zpu_mem_get_attr(zpu_mem) & ZPU_MEM_ATTR_WR ) || !zpu_mem->prot_enabled ) )
+    if ( zpu_seg && ( ( zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_WR ) || !zpu_seg->prot_enabled ) )
     {
-        if ( !zpu_mem_override_set_uint8 ( zpu_mem, va, w ) )
+        zpu_mem_charge( zpu_seg );
+        if ( !zpu_mem_override_set_uint8 ( zpu_seg, va, w ) )
         {
-            void* pa = zpu_va_to_pa( zpu_seg, va ^ 0x03 );
+            void* pa = zpu_va_to_pa_wr( zpu_seg, va ^ 0x03 );
             uint8_t* p = (uint8_t*)pa;
+            if ( !p )
+            {
+                zpu_segv_handler( zpu_mem, va );
+                return;
+            }
             *p = w;
         }
+        if ( zpu_mem_watched( zpu_seg, va ) )
+            zpu_watch_check( zpu_seg, va, sizeof(w), ZPU_MEM_ATTR_WR, w );
         return;
     }
     zpu_segv_handler( zpu_mem, va );
@@ -212,11 +464,65 @@ static void* zpu_va_to_pa( zpu_mem_t* zpu_mem, uint32_t va )
     if ( zpu_mem )
     {
         uint32_t delta = va - zpu_mem->virtual_base;
+        if ( zpu_mem->pages )
+        {
+            uint8_t* page = (uint8_t*)zpu_mem->pages[ delta >> ZPU_MEM_PAGE_SHIFT ];
+            if ( !page )
+                page = (uint8_t*)zpu_mem_zero_page;
+            return page + ( delta & ZPU_MEM_PAGE_MASK );
+        }
         return ((uint8_t*)zpu_mem->physical_base) + delta;
     }
     return (uint32_t*)ZPU_MEM_BAD;
 }
 
+static uint8_t zpu_mem_load_uint8( zpu_mem_t* zpu_seg, uint32_t va )
+{
+    uint8_t value;
+    if ( !zpu_mem_override_get_uint8 ( zpu_seg, va, &value ) )
+    {
+        void* pa = zpu_va_to_pa( zpu_seg, va ^ 0x03 );
+        uint8_t* p = (uint8_t*)pa;
+        value = *p;
+    }
+    return value;
+}
+
+/**
+ * @brief As zpu_va_to_pa() for a store, allocates untouched sparse pages and
+ * copies deduplicated pages before the first write.
+ * @return NULL if a page could not be allocated.
+ */
+static void* zpu_va_to_pa_wr( zpu_mem_t* zpu_mem, uint32_t va )
+{
+    if ( zpu_mem->pages )
+    {
+        uint32_t delta = va - zpu_mem->virtual_base;
+        uint32_t index = delta >> ZPU_MEM_PAGE_SHIFT;
+        void** page = &zpu_mem->pages[ index ];
+        if ( !*page )
+        {
+            if ( (*page = calloc( 1, ZPU_MEM_PAGE_SIZE )) == NULL )
+                return NULL;
+            ++zpu_mem->resident;
+        }
+        else if ( zpu_mem_page_merged( zpu_mem, index ) )
+        {
+            void* copy = malloc( ZPU_MEM_PAGE_SIZE );
+            if ( copy == NULL )
+                return NULL;
+            memcpy( copy, *page, ZPU_MEM_PAGE_SIZE );
+            zpu_dedup_put( *page );
+            *page = copy;
+            zpu_mem->merged_map[ index >> 3 ] &= ~( 1 << ( index & 7 ) );
+            --zpu_mem->merged;
+            ++zpu_mem->resident;
+        }
+        return ((uint8_t*)*page) + ( delta & ZPU_MEM_PAGE_MASK );
+    }
+    return zpu_va_to_pa( zpu_mem, va );
+}
+
 extern void __attribute__((weak)) zpu_opcode_fetch_notify( zpu_mem_t* zpu_mem, uint32_t va )
 {
     /* NOP */
@@ -35,6 +35,23 @@
 #define ZPU_MEM_ATTR_WR 0x02
 #define ZPU_MEM_ATTR_EX 0x04
 #define ZPU_MEM_ATTR_IO 0x08
+#define ZPU_MEM_ATTR_SYNC 0x10
+
+#define ZPU_MEM_PAGE_SHIFT  12
+#define ZPU_MEM_PAGE_SIZE   (1<<ZPU_MEM_PAGE_SHIFT)
+#define ZPU_MEM_PAGE_MASK   (ZPU_MEM_PAGE_SIZE-1)
+
+/** 
+ * A host buffer which may be linked into the memory map of many instances.
+ * Each instance links its own zpu_mem_t descriptor, so the segment chain
+ * is never shared, only the physical buffer.
+ */
+typedef struct _zpu_mem_share_
+{
+    void*               physical_base;
+    uint32_t            size;
+    uint32_t            refs;
+} zpu_mem_share_t;
 
 typedef struct _zpu_mem_
 {
@@ -45,6 +62,16 @@ typedef struct _zpu_mem_
     uint32_t            size;
     uint8_t             attr;
     bool                prot_enabled;
+    zpu_mem_share_t*    share;
+    void**              pages;
+    uint32_t            resident;
+    struct _zpu_watch_* watch;
+    uint8_t*            watch_map;
+    uint32_t            watch_ex;
+    uint32_t            cost;
+    uint64_t*           meter;
+    uint8_t*            merged_map;
+    uint32_t            merged;
 } zpu_mem_t;
 
 #define zpu_mem_set_physical_base(zpu_mem,b)    ((zpu_mem)->physical_base = (b)) 
@@ -56,6 +83,23 @@ typedef struct _zpu_mem_
 #define zpu_mem_get_name(zpu_mem)               ((zpu_mem)->name)
 #define zpu_mem_set_attr(zpu_mem,n)             ((zpu_mem)->attr = (n))
 #define zpu_mem_get_attr(zpu_mem)               ((zpu_mem)->attr)
+#define zpu_mem_get_share(zpu_mem)              ((zpu_mem)->share)
+#define zpu_mem_is_sparse(zpu_mem)              ((zpu_mem)->pages != NULL)
+#define zpu_mem_get_resident(zpu_mem)           ((zpu_mem)->resident * ZPU_MEM_PAGE_SIZE)
+#define zpu_mem_get_merged(zpu_mem)             ((zpu_mem)->merged * ZPU_MEM_PAGE_SIZE)
+
+/** true when page (an index into the page table) is a deduplicated copy on write page */
+#define zpu_mem_page_merged(zpu_mem,page)       ( (zpu_mem)->merged_map[ (page) >> 3 ] & ( 1 << ( (page) & 7 ) ) )
+
+/** charge a segment access to the instance cycle counter */
+#define zpu_mem_charge(zpu_mem)                 do { if ( (zpu_mem)->meter ) *(zpu_mem)->meter += (zpu_mem)->cost; } while (0)
+
+/** true when va lies in a page of the segment holding a watchpoint */
+#define zpu_mem_watched(zpu_mem,va)             ( (zpu_mem)->watch_map && \
+            ( (zpu_mem)->watch_map[ ((va)-(zpu_mem)->virtual_base) >> (ZPU_MEM_PAGE_SHIFT+3) ] & \
+              ( 1 << ( ( ((va)-(zpu_mem)->virtual_base) >> ZPU_MEM_PAGE_SHIFT ) & 7 ) ) ) )
+
+#define zpu_mem_share_get_refs(share)           ((share)->refs)
 
 extern void         zpu_mem_init( zpu_mem_t* zpu_mem_root, 
                                   zpu_mem_t* zpu_mem_seg, 
@@ -65,7 +109,34 @@ extern void         zpu_mem_init( zpu_mem_t* zpu_mem_root,
                                   uint32_t size,
                                   uint8_t attr );
 
+extern void         zpu_mem_share_init( zpu_mem_share_t* share,
+                                        void* physical_base,
+                                        uint32_t size );
+
+extern void         zpu_mem_init_shared( zpu_mem_t* zpu_mem_root, 
+                                         zpu_mem_t* zpu_mem_seg, 
+                                         const char* name, 
+                                         zpu_mem_share_t* share, 
+                                         uint32_t virtual_base, 
+                                         uint8_t attr );
+
+extern uint32_t     zpu_mem_release( zpu_mem_t* zpu_mem_seg );
+
+extern bool         zpu_mem_init_sparse( zpu_mem_t* zpu_mem_root, 
+                                         zpu_mem_t* zpu_mem_seg, 
+                                         const char* name, 
+                                         uint32_t virtual_base, 
+                                         uint32_t size,
+                                         uint8_t attr );
+
+extern void         zpu_mem_sparse_release( zpu_mem_t* zpu_mem_seg, uint32_t va, uint32_t size );
+extern void         zpu_mem_sparse_free( zpu_mem_t* zpu_mem_seg );
+
 extern void         zpu_mem_set_prot( zpu_mem_t* zpu_mem, bool enabled );
+extern zpu_mem_t*   zpu_mem_lookup( zpu_mem_t* zpu_mem_root, uint32_t va );
+extern uint8_t*     zpu_mem_direct( zpu_mem_t* zpu_mem_root, uint32_t va, uint32_t* avail, uint8_t access );
+extern bool         zpu_mem_peek_uint32( zpu_mem_t* zpu_mem_root, uint32_t va, uint32_t* value );
+extern bool         zpu_mem_peek_uint8( zpu_mem_t* zpu_mem_root, uint32_t va, uint8_t* value );
 
 extern uint32_t     zpu_mem_get_uint32( zpu_mem_t* zpu_mem, uint32_t va );
 extern uint16_t     zpu_mem_get_uint16( zpu_mem_t* zpu_mem, uint32_t va );
@@ -0,0 +1,73 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_OPCODES_H
+#define ZPU_OPCODES_H
+
+#define ZPU_IM               128
+#define ZPU_BREAKPOINT       0
+#define ZPU_PUSHSP           2
+#define ZPU_POPPC            4
+#define ZPU_ADD              5
+#define ZPU_AND              6
+#define ZPU_OR               7
+#define ZPU_LOAD             8
+#define ZPU_NOT              9
+#define ZPU_FLIP             10
+#define ZPU_NOP              11
+#define ZPU_STORE            12
+#define ZPU_POPSP            13
+#define ZPU_ADDSP            16
+#define ZPU_EMULATE          32
+#define ZPU_LOADH            34
+#define ZPU_STOREH           35
+#define ZPU_LESSTHAN         36
+#define ZPU_LESSTHANOREQUAL  37
+#define ZPU_ULESSTHAN        38
+#define ZPU_ULESSTHANOREQUAL 39
+#define ZPU_SWAP             40
+#define ZPU_MULT             41
+#define ZPU_LSHIFTRIGHT      42
+#define ZPU_ASHIFTLEFT       43
+#define ZPU_ASHIFTRIGHT      44
+#define ZPU_CALL             45
+#define ZPU_EQ               46
+#define ZPU_NEQ              47
+#define ZPU_NEG              48
+#define ZPU_SUB              49
+#define ZPU_XOR              50
+#define ZPU_LOADB            51
+#define ZPU_STOREB           52
+#define ZPU_DIV              53
+#define ZPU_MOD              54
+#define ZPU_EQBRANCH         55
+#define ZPU_NEQBRANCH        56
+#define ZPU_POPPCREL         57
+#define ZPU_CONFIG           58
+#define ZPU_PUSHPC           59
+#define ZPU_SYSCALL          60
+#define ZPU_PUSHSPADD        61
+#define ZPU_MULT16X16        62
+#define ZPU_CALLPCREL        63
+#define ZPU_STORESP          64
+#define ZPU_LOADSP           96
+
+#endif
@@ -0,0 +1,175 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <string.h>
+
+#include <zpu_prof.h>
+#include <zpu_mem.h>
+#include <zpu_opcodes.h>
+
+static bool     prof_is_return( zpu_mem_t* zpu_mem, uint32_t va );
+static uint32_t prof_symbolize( zpu_prof_t* prof, uint32_t va );
+static uint32_t prof_hash( const uint32_t* frames, uint32_t depth );
+
+/**
+ * @brief Initialize a profiler with room for 'capacity' distinct stacks.
+ * @param elf optional symbol table, when present frames are folded to function entry.
+ */
+extern bool zpu_prof_init( zpu_prof_t* prof, const zpu_elf_t* elf, uint32_t period, uint32_t capacity )
+{
+    prof->elf = elf;
+    prof->period = period ? period : 1;
+    prof->capacity = capacity;
+    prof->used = 0;
+    prof->samples = 0;
+    prof->dropped = 0;
+    prof->stacks = (zpu_prof_stack_t*)calloc( capacity, sizeof(zpu_prof_stack_t) );
+    return prof->stacks != NULL;
+}
+
+extern void zpu_prof_free( zpu_prof_t* prof )
+{
+    free( prof->stacks );
+    prof->stacks = NULL;
+    prof->capacity = 0;
+    prof->used = 0;
+}
+
+/**
+ * @brief Start sampling an instance, must follow zpu_reset().
+ */
+extern void zpu_prof_attach( zpu_prof_t* prof, zpu_t* zpu )
+{
+    zpu->prof_countdown = prof->period;
+    zpu->prof = prof;
+}
+
+extern void zpu_prof_detach( zpu_t* zpu )
+{
+    zpu->prof = NULL;
+}
+
+/**
+ * @brief Record the current guest call stack. Called from zpu_execute().
+ * Return addresses are recovered by scanning the guest stack for words
+ * which follow a ZPU_CALL or ZPU_CALLPCREL opcode.
+ */
+extern void zpu_prof_sample( zpu_prof_t* prof, zpu_t* zpu )
+{
+    zpu_mem_t* zpu_mem = zpu_get_mem(zpu);
+    uint32_t frames[ZPU_PROF_MAX_DEPTH];
+    uint32_t depth = 0;
+    uint32_t hash;
+
+    zpu->prof_countdown = prof->period;
+    ++prof->samples;
+
+    frames[depth++] = prof_symbolize( prof, zpu_get_pc(zpu) );
+    if ( prof_is_return( zpu_mem, zpu_get_tos(zpu) ) )
+    {
+        frames[depth++] = prof_symbolize( prof, zpu_get_tos(zpu) );
+    }
+    for( uint32_t n=1; n < ZPU_PROF_MAX_WALK && depth < ZPU_PROF_MAX_DEPTH; n++ )
+    {
+        uint32_t va;
+        if ( !zpu_mem_peek_uint32( zpu_mem, zpu_get_sp(zpu) + n * 4, &va ) )
+            break;
+        if ( prof_is_return( zpu_mem, va ) )
+        {
+            frames[depth++] = prof_symbolize( prof, va );
+        }
+    }
+
+    hash = prof_hash( frames, depth );
+    for( uint32_t probe=0; probe < prof->capacity; probe++ )
+    {
+        zpu_prof_stack_t* stack = &prof->stacks[ (hash + probe) % prof->capacity ];
+        if ( stack->count == 0 )
+        {
+            stack->hash = hash;
+            stack->depth = depth;
+            memcpy( stack->frames, frames, depth * sizeof(uint32_t) );
+            stack->count = 1;
+            ++prof->used;
+            return;
+        }
+        if ( stack->hash == hash && stack->depth == depth && memcmp( stack->frames, frames, depth * sizeof(uint32_t) ) == 0 )
+        {
+            ++stack->count;
+            return;
+        }
+    }
+    ++prof->dropped;
+}
+
+/**
+ * @brief Write the samples in folded stack format, "outer;inner count" per line.
+ */
+extern void zpu_prof_write_folded( zpu_prof_t* prof, FILE* fp )
+{
+    for( uint32_t n=0; n < prof->capacity; n++ )
+    {
+        zpu_prof_stack_t* stack = &prof->stacks[n];
+        if ( stack->count == 0 )
+            continue;
+        for( uint32_t frame=stack->depth; frame > 0; frame-- )
+        {
+            const zpu_sym_t* zpu_sym = prof->elf ? zpu_elf_lookup_addr( prof->elf, stack->frames[frame-1] ) : NULL;
+            if ( zpu_sym )
+                fprintf( fp, "%s%s", zpu_sym->name, frame > 1 ? ";" : "" );
+            else
+                fprintf( fp, "0x%08x%s", stack->frames[frame-1], frame > 1 ? ";" : "" );
+        }
+        fprintf( fp, " %llu\n", (unsigned long long)stack->count );
+    }
+}
+
+static bool prof_is_return( zpu_mem_t* zpu_mem, uint32_t va )
+{
+    zpu_mem_t* zpu_seg = zpu_mem_lookup( zpu_mem, va - 1 );
+    if ( va && zpu_seg && !(zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_IO) && (zpu_mem_get_attr(zpu_seg) & ZPU_MEM_ATTR_EX) )
+    {
+        uint8_t opcode;
+        return zpu_mem_peek_uint8( zpu_seg, va - 1, &opcode ) && ( opcode == ZPU_CALL || opcode == ZPU_CALLPCREL );
+    }
+    return false;
+}
+
+static uint32_t prof_symbolize( zpu_prof_t* prof, uint32_t va )
+{
+    if ( prof->elf )
+    {
+        const zpu_sym_t* zpu_sym = zpu_elf_lookup_addr( prof->elf, va );
+        if ( zpu_sym )
+            return zpu_sym->addr;
+    }
+    return va;
+}
+
+static uint32_t prof_hash( const uint32_t* frames, uint32_t depth )
+{
+    uint32_t hash = 2166136261u;
+    for( uint32_t n=0; n < depth; n++ )
+    {
+        hash = ( hash ^ frames[n] ) * 16777619u;
+    }
+    return hash;
+}
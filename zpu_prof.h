@@ -0,0 +1,68 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_PROF_H
+#define ZPU_PROF_H
+
+#include <stdio.h>
+
+#include <zpu.h>
+#include <zpu_elf.h>
+
+#define ZPU_PROF_MAX_DEPTH      32
+#define ZPU_PROF_MAX_WALK       256
+
+typedef struct _zpu_prof_stack_
+{
+    uint64_t            count;
+    uint32_t            hash;
+    uint32_t            depth;
+    uint32_t            frames[ZPU_PROF_MAX_DEPTH];
+} zpu_prof_stack_t;
+
+/**
+ * Sampling profiler. zpu_execute() samples the guest every 'period'
+ * instructions, choose period as (guest instructions per second / 1000)
+ * for roughly 1 kHz sampling. Translated (zpu2c) blocks count each of
+ * their instructions but are sampled at block exit.
+ */
+typedef struct _zpu_prof_
+{
+    const zpu_elf_t*    elf;
+    uint32_t            period;
+    zpu_prof_stack_t*   stacks;
+    uint32_t            capacity;
+    uint32_t            used;
+    uint64_t            samples;
+    uint64_t            dropped;
+} zpu_prof_t;
+
+#define zpu_prof_get_samples(prof)              ((prof)->samples)
+#define zpu_prof_get_dropped(prof)              ((prof)->dropped)
+
+extern bool     zpu_prof_init        ( zpu_prof_t* prof, const zpu_elf_t* elf, uint32_t period, uint32_t capacity );
+extern void     zpu_prof_free        ( zpu_prof_t* prof );
+extern void     zpu_prof_attach      ( zpu_prof_t* prof, zpu_t* zpu );
+extern void     zpu_prof_detach      ( zpu_t* zpu );
+extern void     zpu_prof_sample      ( zpu_prof_t* prof, zpu_t* zpu );
+extern void     zpu_prof_write_folded( zpu_prof_t* prof, FILE* fp );
+
+#endif
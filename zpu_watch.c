@@ -0,0 +1,118 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#include <stdlib.h>
+
+#include <zpu_watch.h>
+
+static bool watch_map_build( zpu_mem_t* zpu_mem );
+
+/**
+ * @brief Arm a watchpoint on va..va+size, which must lie within one segment.
+ * @param access any of ZPU_MEM_ATTR_RD, ZPU_MEM_ATTR_WR and ZPU_MEM_ATTR_EX
+ * @return false if no single segment maps the range.
+ */
+extern bool zpu_watch_add( zpu_mem_t* zpu_mem_root, 
+                           zpu_watch_t* watch, 
+                           uint32_t va, 
+                           uint32_t size, 
+                           uint8_t access, 
+                           zpu_watch_fn_t fn, 
+                           void* arg )
+{
+    zpu_mem_t* zpu_seg = zpu_mem_lookup( zpu_mem_root, va );
+    if ( !zpu_seg || size == 0 || size > zpu_seg->size - (va - zpu_seg->virtual_base) )
+        return false;
+    watch->root = zpu_mem_root;
+    watch->seg = zpu_seg;
+    watch->va = va;
+    watch->size = size;
+    watch->access = access;
+    watch->fn = fn;
+    watch->arg = arg;
+    watch->next = zpu_seg->watch;
+    zpu_seg->watch = watch;
+    if ( !watch_map_build( zpu_seg ) )
+    {
+        zpu_seg->watch = watch->next;
+        watch_map_build( zpu_seg );
+        return false;
+    }
+    if ( access & ZPU_MEM_ATTR_EX )
+        ++zpu_mem_root->watch_ex;
+    return true;
+}
+
+extern void zpu_watch_remove( zpu_watch_t* watch )
+{
+    zpu_mem_t* zpu_seg = watch->seg;
+    for( zpu_watch_t** next=&zpu_seg->watch; *next; next=&(*next)->next )
+    {
+        if ( *next == watch )
+        {
+            *next = watch->next;
+            if ( watch->access & ZPU_MEM_ATTR_EX )
+                --watch->root->watch_ex;
+            break;
+        }
+    }
+    watch_map_build( zpu_seg );
+}
+
+/**
+ * @brief Called by the zpu_mem accessors for accesses to a watched page.
+ */
+extern void zpu_watch_check( zpu_mem_t* zpu_mem, uint32_t va, uint32_t size, uint8_t access, uint32_t value )
+{
+    for( zpu_watch_t* watch=zpu_mem->watch; watch; watch=watch->next )
+    {
+        if ( (watch->access & access) && va < watch->va + watch->size && watch->va < va + size )
+        {
+            watch->fn( watch, zpu_mem, va, access, value );
+        }
+    }
+}
+
+/**
+ * @brief Rebuild the watched page bitmap of a segment, freeing it when no watchpoints remain.
+ */
+static bool watch_map_build( zpu_mem_t* zpu_mem )
+{
+    uint32_t pages = ( zpu_mem->size + ZPU_MEM_PAGE_MASK ) >> ZPU_MEM_PAGE_SHIFT;
+    uint8_t* watch_map = NULL;
+    if ( zpu_mem->watch )
+    {
+        if ( (watch_map = (uint8_t*)calloc( (pages + 7) / 8, 1 )) == NULL )
+            return false;
+        for( zpu_watch_t* watch=zpu_mem->watch; watch; watch=watch->next )
+        {
+            uint32_t first = ( watch->va - zpu_mem->virtual_base ) >> ZPU_MEM_PAGE_SHIFT;
+            uint32_t last  = ( watch->va - zpu_mem->virtual_base + watch->size - 1 ) >> ZPU_MEM_PAGE_SHIFT;
+            for( uint32_t page=first; page <= last; page++ )
+            {
+                watch_map[ page >> 3 ] |= ( 1 << (page & 7) );
+            }
+        }
+    }
+    free( zpu_mem->watch_map );
+    zpu_mem->watch_map = watch_map;
+    return true;
+}
@@ -0,0 +1,67 @@
+/****************************************************************************
+ * Copyright (c) 2020 Mike Sharkey <mike@pikeaero.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a 
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+ * and/or sell copies of the Software, and to permit persons to whom the 
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+ * DEALINGS IN THE SOFTWARE.
+ ****************************************************************************/
+#ifndef ZPU_WATCH_H
+#define ZPU_WATCH_H
+
+#include <zpu_mem.h>
+
+typedef struct _zpu_watch_ zpu_watch_t;
+
+/** 
+ * called after a watched access completes
+ * @param access one of ZPU_MEM_ATTR_RD, ZPU_MEM_ATTR_WR or ZPU_MEM_ATTR_EX
+ * @param value the value loaded, stored or fetched
+ */
+typedef void (*zpu_watch_fn_t)( zpu_watch_t* watch, zpu_mem_t* zpu_mem, uint32_t va, uint8_t access, uint32_t value );
+
+/**
+ * A data watchpoint on one segment of an instance memory map. Only the
+ * pages holding a watched range pay for the range comparison.
+ * Translated (zpu2c) code does not fetch through zpu_mem_get_opcode(), so
+ * zpu_execute() interprets while any ZPU_MEM_ATTR_EX watchpoint is armed.
+ */
+struct _zpu_watch_
+{
+    struct _zpu_watch_* next;
+    zpu_mem_t*          root;
+    zpu_mem_t*          seg;
+    uint32_t            va;
+    uint32_t            size;
+    uint8_t             access;
+    zpu_watch_fn_t      fn;
+    void*               arg;
+};
+
+#define zpu_watch_get_arg(watch)                ((watch)->arg)
+
+extern bool zpu_watch_add   ( zpu_mem_t* zpu_mem_root, 
+                              zpu_watch_t* watch, 
+                              uint32_t va, 
+                              uint32_t size, 
+                              uint8_t access, 
+                              zpu_watch_fn_t fn, 
+                              void* arg );
+
+extern void zpu_watch_remove( zpu_watch_t* watch );
+extern void zpu_watch_check ( zpu_mem_t* zpu_mem, uint32_t va, uint32_t size, uint8_t access, uint32_t value );
+
+#endif